@@ -3,6 +3,7 @@
 #include <vector>
 #include <cctype>
 #include <cstdlib>
+#include <chrono>
 
 #include "lib/nlohmann/json.hpp"
 #include <cpr/cpr.h>
@@ -12,9 +13,94 @@
 #include "metainfo/metainfo.hpp"
 #include "client/client.hpp"
 #include "client/connection.hpp"
+#include "client/ioEngine.hpp"
+#include "storage/storage.hpp"
+#include "bench/benchmark.hpp"
 
 using json = nlohmann::json;
 
+/**
+ * @brief extracts the --option=value flags from the arguments into the client configuration, leaving the positional arguments in place
+ *
+ * @param argc
+ * @param argv
+ * @return ClientConfig
+ */
+ClientConfig parse_client_config(int &argc, char *argv[])
+{
+    ClientConfig config;
+    int positional = 0;
+
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument.rfind("--", 0) != 0 || argument.find('=') == std::string::npos)
+        {
+            argv[positional++] = argv[i];
+            continue;
+        }
+
+        std::string option = argument.substr(2, argument.find('=') - 2);
+        std::string value = argument.substr(argument.find('=') + 1);
+
+        if (option == "io-engine")
+        {
+            config.io_backend = IoEngine::parse_backend(value);
+        }
+        else if (option == "event-loops")
+        {
+            config.event_loops = std::stoul(value);
+        }
+        else if (option == "hash-threads")
+        {
+            config.hash_threads = std::stoul(value);
+        }
+        else if (option == "incremental-hashing")
+        {
+            if (value != "on" && value != "off")
+            {
+                throw std::runtime_error("invalid value for --incremental-hashing: " + value);
+            }
+            config.incremental_hashing = value == "on";
+        }
+        else if (option == "max-peers")
+        {
+            config.max_peers = std::stoul(value);
+            if (config.max_peers == 0)
+            {
+                throw std::runtime_error("invalid value for --max-peers: " + value);
+            }
+        }
+        else if (option == "max-piece-memory")
+        {
+            config.max_piece_memory = std::stoul(value) * 1024 * 1024;
+        }
+        else if (option == "storage")
+        {
+            config.storage_backend = Storage::parse_backend(value);
+        }
+        else if (option == "connect-timeout")
+        {
+            config.timeouts.connect = std::chrono::seconds(std::stoul(value));
+        }
+        else if (option == "handshake-timeout")
+        {
+            config.timeouts.handshake = std::chrono::seconds(std::stoul(value));
+        }
+        else if (option == "idle-timeout")
+        {
+            config.timeouts.idle = std::chrono::seconds(std::stoul(value));
+        }
+        else
+        {
+            throw std::runtime_error("unknown option: --" + option);
+        }
+    }
+
+    argc = positional;
+    return config;
+}
+
 /**
  * @brief handles the decode command
  *
@@ -69,6 +155,14 @@ int info_command(int argc, char *argv[])
         std::cout << "Tracker URL: " << meta_info.get_announceURL() << std::endl;
         std::cout << "Length: " << meta_info.get_file_size() << std::endl;
         std::cout << "Info Hash: " << meta_info.get_info_hash() << std::endl;
+        if (meta_info.is_multi_file())
+        {
+            std::cout << "Files: " << std::endl;
+            for (const TorrentFile &file : meta_info.get_files())
+            {
+                std::cout << file.path << " (" << file.length << ")" << std::endl;
+            }
+        }
         std::cout << "Piece Length: " << meta_info.get_piece_length() << std::endl;
         std::cout << "Piece Hashes: " << std::endl;
         for (auto &hash : meta_info.get_pieces_hash())
@@ -202,7 +296,7 @@ int download_piece_command(int argc, char *argv[])
  * @param argv
  * @return int
  */
-int download_file_command(int argc, char *argv[])
+int download_file_command(int argc, char *argv[], ClientConfig config)
 {
     if (argc < 5)
     {
@@ -216,7 +310,7 @@ int download_file_command(int argc, char *argv[])
     try
     {
         MetaInfo metaInfo = MetaInfo(torrent_file);
-        Client cli = Client();
+        Client cli = Client(config);
         cli.download_file(metaInfo, output_file);
         std::cout << "Downloaded " << torrent_file << " to " << output_file << "." << std::endl;
     }
@@ -229,11 +323,48 @@ int download_file_command(int argc, char *argv[])
     return 0;
 }
 
+/**
+ * @brief handles the bench command
+ *
+ * @param argc
+ * @param argv
+ * @return int
+ */
+int bench_command(int argc, char *argv[])
+{
+    std::string suite = argc >= 3 ? argv[2] : "all";
+
+    try
+    {
+        size_t volume = (argc >= 4 ? std::stoul(argv[3]) : 256) * 1024 * 1024;
+        Benchmark benchmark = Benchmark(volume);
+        benchmark.run(suite);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     std::cout << std::unitbuf;
     std::cerr << std::unitbuf;
 
+    ClientConfig config;
+    try
+    {
+        config = parse_client_config(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
     if (argc < 2)
     {
         std::cerr << "Usage: \t " << argv[0] << " decode <encoded_value>" << std::endl;
@@ -241,7 +372,8 @@ int main(int argc, char *argv[])
         std::cerr << "\t " << argv[0] << " peers <torrent file>" << std::endl;
         std::cerr << "\t " << argv[0] << " handshake <torrent file> <peer_ip>:<peer_port>" << std::endl;
         std::cerr << "\t " << argv[0] << " download_piece -o <output_file> <torrent file> <piece_index>" << std::endl;
-        std::cerr << "\t " << argv[0] << " download -o <output_file> <torrent file>" << std::endl;
+        std::cerr << "\t " << argv[0] << " download [--io-engine=epoll|io_uring] [--event-loops=<n>] [--hash-threads=<n>] [--incremental-hashing=on|off] [--max-peers=<n>] [--max-piece-memory=<MiB>] [--storage=pwrite|mmap] [--connect-timeout=<s>] [--handshake-timeout=<s>] [--idle-timeout=<s>] -o <output_file> <torrent file>" << std::endl;
+        std::cerr << "\t " << argv[0] << " bench [all|hash|lanes|incremental|recheck] [<MiB per round>]" << std::endl;
         return 1;
     }
 
@@ -269,7 +401,11 @@ int main(int argc, char *argv[])
     }
     else if (command == "download")
     {
-        return download_file_command(argc, argv);
+        return download_file_command(argc, argv, config);
+    }
+    else if (command == "bench")
+    {
+        return bench_command(argc, argv);
     }
     else
     {
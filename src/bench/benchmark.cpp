@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <optional>
+#include <stdexcept>
+
+#include "bench/benchmark.hpp"
+#include "metainfo/sha1Engine.hpp"
+#include "metainfo/sha1MultiBuffer.hpp"
+#include "metainfo/metainfo.hpp"
+#include "client/hashPool.hpp"
+#include "client/pieceBufferPool.hpp"
+#include "client/requestWindow.hpp"
+#include "storage/storage.hpp"
+
+namespace
+{
+    constexpr size_t INPUT_SIZE = 64 * 1024 * 1024;
+    constexpr int ROUNDS = 3;
+
+    // the piece sizes found in practice, from small torrents to large ones
+    constexpr size_t MESSAGE_SIZES[] = {16 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+}
+
+Benchmark::Benchmark(size_t volume) : volume(volume), data(INPUT_SIZE), sink(0)
+{
+    std::mt19937_64 generator(0x5eed);
+    for (size_t i = 0; i + 8 <= this->data.size(); i += 8)
+    {
+        uint64_t value = generator();
+        std::copy_n(reinterpret_cast<const uint8_t *>(&value), 8, this->data.data() + i);
+    }
+}
+
+std::vector<std::string> Benchmark::get_suites()
+{
+    return {"hash", "lanes", "incremental", "recheck"};
+}
+
+void Benchmark::run(const std::string &suite)
+{
+    if (suite == "all")
+    {
+        for (const std::string &name : get_suites())
+        {
+            this->run(name);
+        }
+        return;
+    }
+
+    if (suite == "hash")
+    {
+        this->bench_hash();
+    }
+    else if (suite == "lanes")
+    {
+        this->bench_lanes();
+    }
+    else if (suite == "incremental")
+    {
+        this->bench_incremental();
+    }
+    else if (suite == "recheck")
+    {
+        this->bench_recheck();
+    }
+    else
+    {
+        throw std::runtime_error("unknown benchmark: " + suite);
+    }
+}
+
+double Benchmark::measure(size_t bytes, const std::function<void()> &round)
+{
+    // the first rounds also pay for faulting the input in and warming up the caches and vector units
+    auto best = std::chrono::steady_clock::duration::max();
+    for (int i = 0; i < ROUNDS; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        round();
+        best = std::min(best, std::chrono::steady_clock::now() - start);
+    }
+
+    double seconds = std::chrono::duration<double>(best).count();
+    return bytes / seconds / 1e9;
+}
+
+void Benchmark::report(const std::string &suite, const std::string &variant, size_t message_size, double throughput)
+{
+    std::cout << std::left << std::setw(12) << suite << std::setw(24) << variant
+              << std::right << std::setw(6) << message_size / 1024 << " KiB "
+              << std::fixed << std::setprecision(2) << std::setw(8) << throughput << " GB/s" << std::endl;
+}
+
+void Benchmark::bench_hash()
+{
+    for (const std::string &implementation : Sha1Engine::get_available_implementations())
+    {
+        for (size_t message_size : MESSAGE_SIZES)
+        {
+            size_t messages = std::max<size_t>(1, this->volume / message_size);
+            size_t slots = this->data.size() / message_size;
+
+            auto round = [&]()
+            {
+                for (size_t i = 0; i < messages; ++i)
+                {
+                    const uint8_t *message = this->data.data() + (i % slots) * message_size;
+                    this->sink = this->sink ^ Sha1Engine::hash_with(implementation, message, message_size)[0];
+                }
+            };
+            double throughput = this->measure(messages * message_size, round);
+
+            this->report("hash", implementation, message_size, throughput);
+        }
+    }
+}
+
+void Benchmark::bench_lanes()
+{
+    // enough messages to fill the widest kernel, the hash pool hands it pieces in groups like these
+    const size_t GROUP_SIZE = 16;
+
+    for (size_t lanes : Sha1MultiBuffer::get_available_lanes())
+    {
+        std::string variant = std::to_string(lanes) + (lanes == 1 ? " lane (" + Sha1Engine::get_implementation() + ")" : " lanes");
+
+        for (size_t message_size : MESSAGE_SIZES)
+        {
+            size_t slots = this->data.size() / message_size;
+            size_t groups = std::max<size_t>(1, this->volume / (message_size * GROUP_SIZE));
+
+            std::vector<const uint8_t *> messages;
+            for (size_t i = 0; i < groups * GROUP_SIZE; ++i)
+            {
+                messages.push_back(this->data.data() + (i % slots) * message_size);
+            }
+            std::vector<Sha1Digest> digests(GROUP_SIZE);
+
+            auto round = [&]()
+            {
+                for (size_t group = 0; group < groups; ++group)
+                {
+                    Sha1MultiBuffer::hash_with(lanes, messages.data() + group * GROUP_SIZE, GROUP_SIZE, message_size, digests.data());
+                    this->sink = this->sink ^ digests[0][0];
+                }
+            };
+            double throughput = this->measure(messages.size() * message_size, round);
+
+            this->report("lanes", variant, message_size, throughput);
+        }
+    }
+}
+
+void Benchmark::bench_incremental()
+{
+    const size_t BLOCK_SIZE = RequestWindow::BLOCK_SIZE;
+
+    for (size_t message_size : MESSAGE_SIZES)
+    {
+        size_t slots = this->data.size() / message_size;
+        size_t pieces = std::max<size_t>(1, this->volume / message_size);
+        std::vector<uint8_t> piece(message_size);
+
+        // the blocks are copied into the piece buffer as the event loop does when they arrive
+        auto receive = [&](size_t i, bool incremental)
+        {
+            const uint8_t *source = this->data.data() + (i % slots) * message_size;
+            Sha1Engine hasher;
+            for (size_t begin = 0; begin < message_size; begin += BLOCK_SIZE)
+            {
+                size_t length = std::min(BLOCK_SIZE, message_size - begin);
+                std::memcpy(piece.data() + begin, source + begin, length);
+                if (incremental)
+                {
+                    hasher.update(piece.data() + begin, length);
+                }
+            }
+            if (!incremental)
+            {
+                hasher.update(piece.data(), message_size);
+            }
+            this->sink = this->sink ^ hasher.final()[0];
+        };
+
+        for (bool incremental : {false, true})
+        {
+            auto round = [&]()
+            {
+                for (size_t i = 0; i < pieces; ++i)
+                {
+                    receive(i, incremental);
+                }
+            };
+            double throughput = this->measure(pieces * message_size, round);
+
+            this->report("incremental", incremental ? "per block" : "whole piece", message_size, throughput);
+        }
+    }
+}
+
+void Benchmark::bench_recheck()
+{
+    // a large torrent's pieces, the output file is read back from the page cache, so this is the CPU side of a recheck
+    const size_t PIECE_LENGTHS[] = {256 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+    const std::pair<StorageBackend, const char *> BACKENDS[] = {{StorageBackend::PWRITE, "pwrite"}, {StorageBackend::MMAP, "mmap"}};
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path();
+    std::string output_file = (directory / "bittorrent-bench.bin").string();
+    std::string torrent_file = (directory / "bittorrent-bench.torrent").string();
+
+    for (size_t piece_length : PIECE_LENGTHS)
+    {
+        size_t length = std::max(this->volume, piece_length) / piece_length * piece_length;
+        size_t number_of_pieces = length / piece_length;
+        size_t slots = this->data.size() / piece_length;
+
+        // a torrent of the input, repeated up to the volume
+        std::string pieces;
+        for (size_t i = 0; i < number_of_pieces; ++i)
+        {
+            Sha1Digest digest = Sha1Engine::hash(this->data.data() + (i % slots) * piece_length, piece_length);
+            pieces.append(reinterpret_cast<const char *>(digest.data()), digest.size());
+        }
+        {
+            std::string announce = "http://localhost/announce";
+            std::string name = std::filesystem::path(output_file).filename().string();
+            std::ofstream torrent(torrent_file, std::ios::binary | std::ios::trunc);
+            torrent << "d8:announce" << announce.size() << ":" << announce << "4:infod6:lengthi" << length << "e4:name" << name.size() << ":" << name
+                    << "12:piece lengthi" << piece_length << "e6:pieces" << pieces.size() << ":" << pieces << "ee";
+        }
+        MetaInfo metaInfo(torrent_file);
+
+        {
+            std::unique_ptr<Storage> storage = Storage::create(StorageBackend::PWRITE, metaInfo, output_file);
+            for (size_t i = 0; i < number_of_pieces; ++i)
+            {
+                storage->write_piece(i, this->data.data() + (i % slots) * piece_length, piece_length);
+            }
+            storage->sync();
+        }
+
+        for (const auto &[backend, backend_name] : BACKENDS)
+        {
+            std::unique_ptr<Storage> storage = Storage::create(backend, metaInfo, output_file);
+            PieceBufferPool buffers(piece_length);
+            HashPool hash_pool(metaInfo);
+            std::atomic<size_t> valid_pieces = 0;
+
+            // the loop of Client::resume_download()
+            auto round = [&]()
+            {
+                for (size_t i = 0; i < number_of_pieces; ++i)
+                {
+                    PieceBuffer buffer;
+                    if (!buffers.acquire(buffer))
+                    {
+                        hash_pool.wait();
+                        buffers.acquire(buffer);
+                    }
+
+                    buffer.resize(piece_length);
+                    storage->read_piece(i, [&buffer](const uint8_t *piece_data, size_t size)
+                                        { std::copy(piece_data, piece_data + size, buffer.data()); });
+
+                    hash_pool.submit(i, std::move(buffer), std::nullopt, [&valid_pieces](size_t, PieceBuffer, bool valid)
+                                     {
+                                         if (valid)
+                                         {
+                                             valid_pieces++;
+                                         } });
+                }
+                hash_pool.wait();
+            };
+            double throughput = this->measure(length, round);
+
+            if (valid_pieces != ROUNDS * number_of_pieces)
+            {
+                throw std::runtime_error("recheck benchmark: " + std::to_string(valid_pieces) + " of " + std::to_string(ROUNDS * number_of_pieces) + " pieces verified");
+            }
+
+            size_t threads = hash_pool.get_thread_count();
+            std::string variant = std::string(backend_name) + ", " + std::to_string(threads) + (threads == 1 ? " thread" : " threads");
+            this->report("recheck", variant, piece_length, throughput);
+        }
+    }
+
+    std::filesystem::remove(output_file);
+    std::filesystem::remove(torrent_file);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of the hot paths of a download, run by the bench command. Each measurement processes
+// a fixed number of bytes a few times and reports the best round in GB/s, so the numbers of different
+// implementations, lane counts or strategies can be compared on the machine at hand.
+class Benchmark
+{
+private:
+    // bytes processed per round of a measurement
+    size_t volume;
+    // pseudo-random input, larger than the caches so the kernels stream it from memory as a download would
+    std::vector<uint8_t> data;
+    // the digests are folded into it, so the compiler can't drop the hashing
+    volatile uint8_t sink;
+
+    /**
+     * @brief runs a round a few times and returns the throughput of the fastest one
+     *
+     * @param bytes bytes processed by a round
+     * @param round
+     * @return double GB/s
+     */
+    double measure(size_t bytes, const std::function<void()> &round);
+
+    /**
+     * @brief prints one result line
+     *
+     * @param suite
+     * @param variant
+     * @param message_size
+     * @param throughput GB/s
+     */
+    void report(const std::string &suite, const std::string &variant, size_t message_size, double throughput);
+
+    /**
+     * @brief SHA-1 throughput of every compression function this CPU can run, per piece size
+     */
+    void bench_hash();
+
+    /**
+     * @brief SHA-1 throughput of every multi-buffer kernel this CPU can run, hashing a group of pieces per lane count
+     */
+    void bench_lanes();
+
+    /**
+     * @brief receiving pieces block by block and hashing each block right after it is copied (incremental hashing),
+     * against hashing the whole piece once its last block is in
+     */
+    void bench_incremental();
+
+    /**
+     * @brief the recheck of a resumed download: reading the pieces of an output file through each storage backend
+     * and verifying them on the hashing threads
+     */
+    void bench_recheck();
+
+public:
+    /**
+     * @brief prepares the input of the benchmarks
+     *
+     * @param volume bytes processed per round of a measurement
+     */
+    Benchmark(size_t volume);
+
+    /**
+     * @brief returns the names of the suites run() accepts besides "all"
+     *
+     * @return std::vector<std::string>
+     */
+    static std::vector<std::string> get_suites();
+
+    /**
+     * @brief runs a suite, or every suite for "all"
+     *
+     * @param suite
+     */
+    void run(const std::string &suite);
+};
@@ -16,6 +16,11 @@ json Decode::decode_bencoded_value(const std::string &encoded_value)
 
 json Decode::decode_bencoded_value(const std::string &encoded_value, std::string::const_iterator &it)
 {
+    if (it == std::end(encoded_value))
+    {
+        throw std::runtime_error("Unexpected end of encoded value -> " + encoded_value);
+    }
+
     EncodedValueType type = this->get_encoded_value_type(it);
     switch (type)
     {
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bencode/streamParser.hpp"
+
+// longest length prefix or integer we accept, enough for any int64_t
+constexpr size_t MAX_DIGITS = 20;
+
+StreamParser::StreamParser(BencodeHandler &handler) : handler(handler)
+{
+    this->state = State::VALUE;
+    this->string_left = 0;
+    this->reading_key = false;
+    this->position = 0;
+    this->value_start = 0;
+}
+
+void StreamParser::fail(const std::string &reason)
+{
+    throw std::runtime_error("Invalid bencode at offset " + std::to_string(this->position) + ": " + reason);
+}
+
+void StreamParser::feed(std::string_view chunk)
+{
+    size_t i = 0;
+    while (i < chunk.size())
+    {
+        char c = chunk[i];
+
+        switch (this->state)
+        {
+        case State::DONE:
+            this->fail("trailing data after the value");
+
+        case State::VALUE:
+            if (c == 'e' && !this->containers.empty())
+            {
+                Container container = this->containers.back();
+                if (container.is_dict && !container.expecting_key)
+                {
+                    this->fail("dict key without a value");
+                }
+
+                this->containers.pop_back();
+                this->value_start = container.start;
+                this->position++;
+                this->handler.end();
+                this->end_value();
+            }
+            else
+            {
+                this->begin_value(c);
+            }
+            i++;
+            break;
+
+        case State::INTEGER:
+            if (c != 'e')
+            {
+                if (this->digits.size() == MAX_DIGITS + 1)
+                {
+                    this->fail("integer out of range");
+                }
+                this->digits += c;
+                this->position++;
+                i++;
+                break;
+            }
+            else
+            {
+                std::string_view magnitude = std::string_view(this->digits).substr(this->digits.starts_with('-') ? 1 : 0);
+                if (magnitude.empty())
+                {
+                    this->fail("integer without digits");
+                }
+                if (magnitude[0] == '0' && (magnitude.size() > 1 || magnitude.size() != this->digits.size()))
+                {
+                    this->fail("integer with leading zeros or negative zero");
+                }
+
+                int64_t value;
+                auto [parsed, error] = std::from_chars(this->digits.data(), this->digits.data() + this->digits.size(), value);
+                if (error == std::errc::result_out_of_range)
+                {
+                    this->fail("integer out of range");
+                }
+                if (error != std::errc() || parsed != this->digits.data() + this->digits.size())
+                {
+                    this->fail("integer must contain only digits");
+                }
+
+                this->position++;
+                i++;
+                this->handler.integer(value);
+                this->end_value();
+            }
+            break;
+
+        case State::STRING_LENGTH:
+            if (std::isdigit(static_cast<unsigned char>(c)))
+            {
+                if (this->digits.size() == MAX_DIGITS)
+                {
+                    this->fail("string length out of range");
+                }
+                this->digits += c;
+            }
+            else if (c == ':')
+            {
+                auto [parsed, error] = std::from_chars(this->digits.data(), this->digits.data() + this->digits.size(), this->string_left);
+                if (error != std::errc())
+                {
+                    this->fail("string length out of range");
+                }
+
+                this->state = State::STRING_DATA;
+                if (this->string_left == 0)
+                {
+                    // empty strings have no data to wait for
+                    this->position++;
+                    i++;
+                    this->read_string_data(std::string_view());
+                    break;
+                }
+            }
+            else
+            {
+                this->fail("string length must be followed by ':'");
+            }
+            this->position++;
+            i++;
+            break;
+
+        case State::STRING_DATA:
+            i += this->read_string_data(chunk.substr(i));
+            break;
+        }
+    }
+}
+
+void StreamParser::begin_value(char c)
+{
+    this->value_start = this->position;
+
+    this->reading_key = !this->containers.empty() && this->containers.back().is_dict && this->containers.back().expecting_key;
+    if (this->reading_key && !std::isdigit(static_cast<unsigned char>(c)))
+    {
+        this->fail("dict key must be a string");
+    }
+
+    if (c == 'i')
+    {
+        this->state = State::INTEGER;
+        this->digits.clear();
+        this->position++;
+    }
+    else if (std::isdigit(static_cast<unsigned char>(c)))
+    {
+        this->state = State::STRING_LENGTH;
+        this->digits.assign(1, c);
+        this->key_buffer.clear();
+        this->position++;
+    }
+    else if (c == 'l' || c == 'd')
+    {
+        this->containers.push_back(Container{c == 'd', true, this->position});
+        this->position++;
+        if (c == 'd')
+        {
+            this->handler.begin_dict();
+        }
+        else
+        {
+            this->handler.begin_list();
+        }
+    }
+    else
+    {
+        this->fail(std::string("unexpected character '") + c + "'");
+    }
+}
+
+void StreamParser::end_value()
+{
+    if (this->containers.empty())
+    {
+        this->state = State::DONE;
+        return;
+    }
+
+    this->state = State::VALUE;
+    if (this->containers.back().is_dict)
+    {
+        this->containers.back().expecting_key = true;
+    }
+}
+
+size_t StreamParser::read_string_data(std::string_view chunk)
+{
+    size_t taken = std::min(this->string_left, chunk.size());
+    this->string_left -= taken;
+    this->position += taken;
+    bool last = this->string_left == 0;
+
+    if (this->reading_key)
+    {
+        this->key_buffer.append(chunk.substr(0, taken));
+        if (last)
+        {
+            this->state = State::VALUE;
+            this->containers.back().expecting_key = false;
+            this->handler.key(this->key_buffer);
+        }
+        return taken;
+    }
+
+    this->handler.string(chunk.substr(0, taken), last);
+    if (last)
+    {
+        this->end_value();
+    }
+
+    return taken;
+}
+
+void StreamParser::finish()
+{
+    if (this->state != State::DONE)
+    {
+        this->fail("unexpected end of input");
+    }
+}
+
+bool StreamParser::is_complete()
+{
+    return this->state == State::DONE;
+}
+
+size_t StreamParser::get_value_start()
+{
+    return this->value_start;
+}
+
+size_t StreamParser::get_position()
+{
+    return this->position;
+}
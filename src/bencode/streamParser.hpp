@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Receives the events of a StreamParser, every callback defaults to doing nothing
+class BencodeHandler
+{
+public:
+    virtual ~BencodeHandler() = default;
+
+    virtual void begin_dict() {}
+    virtual void begin_list() {}
+
+    /**
+     * @brief closes the innermost dict or list
+     *
+     */
+    virtual void end() {}
+
+    /**
+     * @brief a dict key, the value event follows
+     *
+     * @param key
+     */
+    virtual void key(std::string_view) {}
+
+    virtual void integer(int64_t) {}
+
+    /**
+     * @brief a string value, delivered in as many fragments as the input was split into
+     *
+     * @param fragment view into the input chunk, only valid during the call
+     * @param last true for the final fragment of the string
+     */
+    virtual void string(std::string_view, bool) {}
+};
+
+// Event-driven bencode parser that can be fed its input in chunks of any size, e.g. straight off a socket,
+// and never builds the decoded value. Only dict keys are buffered, string values are passed through.
+class StreamParser
+{
+private:
+    enum class State
+    {
+        VALUE,         // expecting a value, or the end of the innermost container
+        INTEGER,       // inside i...e
+        STRING_LENGTH, // inside the length prefix of a string
+        STRING_DATA,   // inside the bytes of a string
+        DONE           // the root value is complete
+    };
+
+    struct Container
+    {
+        bool is_dict;
+        // a dict alternates between keys and values
+        bool expecting_key;
+        // offset where the container started
+        size_t start;
+    };
+
+    BencodeHandler &handler;
+    State state;
+    std::vector<Container> containers;
+
+    // digits of the integer or string length being read
+    std::string digits;
+    // bytes left of the string being read, and whether it is a dict key
+    size_t string_left;
+    bool reading_key;
+    std::string key_buffer;
+
+    // offset in the whole input of the next byte to parse
+    size_t position;
+    // offset where the value being parsed started
+    size_t value_start;
+
+    /**
+     * @brief handles the first byte of a value
+     *
+     * @param c
+     */
+    void begin_value(char c);
+
+    /**
+     * @brief called once a value is complete, moves the enclosing dict between keys and values
+     *
+     */
+    void end_value();
+
+    /**
+     * @brief handles the bytes of a string, returns how many of them were used
+     *
+     * @param chunk
+     * @return size_t
+     */
+    size_t read_string_data(std::string_view chunk);
+
+    /**
+     * @brief throws an error pointing at the current offset of the input
+     *
+     * @param reason
+     */
+    [[noreturn]] void fail(const std::string &reason);
+
+public:
+    /**
+     * @brief creates a parser reporting to the given handler
+     *
+     * @param handler
+     */
+    StreamParser(BencodeHandler &handler);
+
+    /**
+     * @brief parses the next chunk of input, throws with the offset of the first error
+     *
+     * @param chunk
+     */
+    void feed(std::string_view chunk);
+
+    /**
+     * @brief throws unless the root value was parsed completely
+     *
+     */
+    void finish();
+
+    /**
+     * @brief returns true once the root value was parsed completely
+     *
+     * @return true
+     * @return false
+     */
+    bool is_complete();
+
+    /**
+     * @brief returns the offset in the whole input where the value of the current event started,
+     * during end() the value ends at get_position()
+     *
+     * @return size_t
+     */
+    size_t get_value_start();
+
+    /**
+     * @brief returns the offset in the whole input of the byte after the current event
+     *
+     * @return size_t
+     */
+    size_t get_position();
+};
@@ -0,0 +1,72 @@
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "client/bitfield.hpp"
+
+Bitfield::Bitfield(size_t number_of_pieces) : bits((number_of_pieces + 7) / 8, 0), number_of_pieces(number_of_pieces)
+{
+}
+
+Bitfield Bitfield::from_payload(const uint8_t *payload, size_t payload_size, size_t number_of_pieces)
+{
+    Bitfield bitfield(number_of_pieces);
+
+    if (payload_size != bitfield.bits.size())
+    {
+        throw std::runtime_error("Invalid bitfield length: " + std::to_string(payload_size) + " bytes for " + std::to_string(number_of_pieces) + " pieces");
+    }
+
+    bitfield.bits.assign(payload, payload + payload_size);
+
+    size_t spare_bits = bitfield.bits.size() * 8 - number_of_pieces;
+    if (spare_bits != 0 && (bitfield.bits.back() & ((1u << spare_bits) - 1)) != 0)
+    {
+        throw std::runtime_error("Bitfield has spare bits set");
+    }
+
+    return bitfield;
+}
+
+bool Bitfield::has(size_t piece_index) const
+{
+    if (piece_index >= this->number_of_pieces)
+    {
+        return false;
+    }
+
+    return (this->bits[piece_index / 8] >> (7 - piece_index % 8)) & 1;
+}
+
+void Bitfield::set(size_t piece_index)
+{
+    if (piece_index >= this->number_of_pieces)
+    {
+        throw std::runtime_error("Invalid piece index: " + std::to_string(piece_index));
+    }
+
+    this->bits[piece_index / 8] |= static_cast<uint8_t>(0x80 >> (piece_index % 8));
+}
+
+size_t Bitfield::get_size() const
+{
+    return this->number_of_pieces;
+}
+
+size_t Bitfield::count() const
+{
+    size_t result = 0;
+    for (uint8_t byte : this->bits)
+    {
+        result += std::popcount(byte);
+    }
+
+    return result;
+}
+
+const std::vector<uint8_t> &Bitfield::get_bytes() const
+{
+    return this->bits;
+}
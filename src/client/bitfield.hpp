@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// The set of pieces a peer has, one bit per piece with the most significant bit of the first byte
+// being piece 0, the layout of the BITFIELD message.
+class Bitfield
+{
+private:
+    std::vector<uint8_t> bits;
+    size_t number_of_pieces;
+
+public:
+    /**
+     * @brief creates an empty bitfield
+     *
+     * @param number_of_pieces
+     */
+    Bitfield(size_t number_of_pieces = 0);
+
+    /**
+     * @brief creates a bitfield from the payload of a BITFIELD message, throws if its length
+     * doesn't match the number of pieces or a spare bit is set
+     *
+     * @param payload
+     * @param payload_size
+     * @param number_of_pieces
+     * @return Bitfield
+     */
+    static Bitfield from_payload(const uint8_t *payload, size_t payload_size, size_t number_of_pieces);
+
+    /**
+     * @brief returns true if the piece is in the set
+     *
+     * @param piece_index
+     * @return true
+     * @return false
+     */
+    bool has(size_t piece_index) const;
+
+    /**
+     * @brief adds the piece to the set
+     *
+     * @param piece_index
+     */
+    void set(size_t piece_index);
+
+    /**
+     * @brief returns the number of pieces the bitfield covers
+     *
+     * @return size_t
+     */
+    size_t get_size() const;
+
+    /**
+     * @brief returns the number of pieces in the set
+     *
+     * @return size_t
+     */
+    size_t count() const;
+
+    /**
+     * @brief returns the packed bits
+     *
+     * @return const std::vector<uint8_t>&
+     */
+    const std::vector<uint8_t> &get_bytes() const;
+};
@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "client/blockScheduler.hpp"
+
+namespace
+{
+    bool test_bit(const std::vector<uint64_t> &bits, size_t i)
+    {
+        return (bits[i / 64] >> (i % 64)) & 1;
+    }
+
+    void set_bit(std::vector<uint64_t> &bits, size_t i)
+    {
+        bits[i / 64] |= uint64_t(1) << (i % 64);
+    }
+
+    void clear_bit(std::vector<uint64_t> &bits, size_t i)
+    {
+        bits[i / 64] &= ~(uint64_t(1) << (i % 64));
+    }
+}
+
+BlockScheduler::BlockScheduler(MetaInfo &metaInfo, PiecePicker &picker, PieceBufferPool &buffers, size_t number_of_shards, bool incremental_hashing)
+    : metaInfo(metaInfo), picker(picker), buffers(buffers), incremental_hashing(incremental_hashing), shards(std::max<size_t>(number_of_shards, 1)),
+      piece_shards(metaInfo.get_number_of_pieces()), single_source(metaInfo.get_number_of_pieces())
+{
+}
+
+BlockScheduler::PartialPiece &BlockScheduler::start_piece(size_t shard, size_t piece_index, const RequestWindow &window, PieceBuffer buffer)
+{
+    size_t piece_length = this->metaInfo.get_piece_length(piece_index);
+    size_t number_of_blocks = (piece_length + RequestWindow::BLOCK_SIZE - 1) / RequestWindow::BLOCK_SIZE;
+    size_t words = (number_of_blocks + 63) / 64;
+
+    this->piece_shards[piece_index].store(shard, std::memory_order_release);
+
+    PartialPiece &piece = this->shards[shard].pieces[piece_index];
+    piece.data = std::move(buffer);
+    piece.data.resize(piece_length);
+    piece.number_of_blocks = number_of_blocks;
+    piece.requested.assign(words, 0);
+    piece.received.assign(words, 0);
+    piece.written.assign(words, 0);
+    piece.requesters.assign(number_of_blocks, 0);
+    piece.blocks_received = 0;
+    piece.blocks_written = 0;
+    piece.hashed_blocks = 0;
+    piece.hash_claimed = 0;
+    piece.out_of_order = false;
+    piece.hashing = false;
+    piece.peers.clear();
+    piece.owner = this->single_source[piece_index].exchange(false) ? &window : nullptr;
+
+    return piece;
+}
+
+void BlockScheduler::add_request(PartialPiece &piece, size_t block)
+{
+    set_bit(piece.requested, block);
+    piece.requesters[block]++;
+}
+
+void BlockScheduler::drop_request(PartialPiece &piece, size_t block)
+{
+    if (piece.requesters[block] > 0 && --piece.requesters[block] == 0)
+    {
+        clear_bit(piece.requested, block);
+    }
+}
+
+uint32_t BlockScheduler::get_block_length(size_t piece_index, size_t block)
+{
+    uint32_t piece_length = this->metaInfo.get_piece_length(piece_index);
+    return std::min<uint32_t>(RequestWindow::BLOCK_SIZE, piece_length - block * RequestWindow::BLOCK_SIZE);
+}
+
+bool BlockScheduler::claim_free_block(size_t shard, const Bitfield &bitfield, const RequestWindow &window, uint32_t &index, size_t &block)
+{
+    for (auto &[piece_index, piece] : this->shards[shard].pieces)
+    {
+        if (!bitfield.has(piece_index) || (piece.owner != nullptr && piece.owner != &window))
+        {
+            continue;
+        }
+
+        for (size_t word = 0; word < piece.requested.size(); ++word)
+        {
+            uint64_t free = ~(piece.requested[word] | piece.received[word]);
+            size_t candidate = word * 64 + std::countr_zero(free);
+            if (free != 0 && candidate < piece.number_of_blocks)
+            {
+                this->add_request(piece, candidate);
+                index = piece_index;
+                block = candidate;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool BlockScheduler::find_endgame_block(size_t shard, const Bitfield &bitfield, RequestWindow &window, uint32_t &index, size_t &block)
+{
+    for (auto &[piece_index, piece] : this->shards[shard].pieces)
+    {
+        if (!bitfield.has(piece_index) || (piece.owner != nullptr && piece.owner != &window))
+        {
+            continue;
+        }
+
+        for (size_t candidate = 0; candidate < piece.number_of_blocks; ++candidate)
+        {
+            if (!test_bit(piece.received, candidate) && !window.contains(piece_index, candidate * RequestWindow::BLOCK_SIZE))
+            {
+                this->add_request(piece, candidate);
+                index = piece_index;
+                block = candidate;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool BlockScheduler::next_block(size_t shard, const Bitfield &bitfield, RequestWindow &window, uint32_t &index, uint32_t &begin, uint32_t &length)
+{
+    size_t number_of_shards = this->shards.size();
+    shard %= number_of_shards;
+
+    size_t block;
+    auto take = [&]()
+    {
+        begin = block * RequestWindow::BLOCK_SIZE;
+        length = this->get_block_length(index, block);
+        return true;
+    };
+
+    // finish the started pieces first, our own shard before stealing from the others
+    for (size_t i = 0; i < number_of_shards; ++i)
+    {
+        size_t victim = (shard + i) % number_of_shards;
+        std::lock_guard<std::mutex> lock(this->shards[victim].mutex);
+        if (this->claim_free_block(victim, bitfield, window, index, block))
+        {
+            return take();
+        }
+    }
+
+    // a new piece needs a buffer, the pool tells the client once one comes back if there is none;
+    // the picker goes first, so a session with nothing to start never takes a buffer and wakes the others handing it back
+    PieceBuffer buffer;
+    size_t piece_index;
+    if (this->picker.pick(bitfield, piece_index))
+    {
+        if (!this->buffers.acquire(buffer))
+        {
+            this->picker.release(piece_index);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(this->shards[shard].mutex);
+        PartialPiece &piece = this->start_piece(shard, piece_index, window, std::move(buffer));
+        this->add_request(piece, 0);
+        index = piece_index;
+        block = 0;
+        return take();
+    }
+
+    if (!this->picker.is_endgame())
+    {
+        return false;
+    }
+
+    // endgame: request the blocks still in flight from this peer as well, the first copy to arrive wins
+    for (size_t i = 0; i < number_of_shards; ++i)
+    {
+        size_t victim = (shard + i) % number_of_shards;
+        std::lock_guard<std::mutex> lock(this->shards[victim].mutex);
+        if (this->find_endgame_block(victim, bitfield, window, index, block))
+        {
+            return take();
+        }
+    }
+
+    return false;
+}
+
+uint8_t *BlockScheduler::begin_block(uint32_t index, uint32_t begin, uint32_t length, const std::string &peer)
+{
+    if (index >= this->piece_shards.size())
+    {
+        return nullptr;
+    }
+
+    Shard &shard = this->shards[this->piece_shards[index].load(std::memory_order_acquire)];
+    size_t block_index = begin / RequestWindow::BLOCK_SIZE;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.pieces.find(index);
+    if (it == shard.pieces.end())
+    {
+        return nullptr;
+    }
+
+    PartialPiece &piece = it->second;
+    if (begin % RequestWindow::BLOCK_SIZE != 0 || block_index >= piece.number_of_blocks ||
+        length != this->get_block_length(index, block_index))
+    {
+        throw std::runtime_error("Received block out of piece bounds, piece: " + std::to_string(index) + " begin: " + std::to_string(begin) + " length: " + std::to_string(length));
+    }
+
+    if (test_bit(piece.received, block_index))
+    {
+        return nullptr;
+    }
+
+    // claims the block, the piece stays in the shard until every claimed block is written
+    set_bit(piece.received, block_index);
+    piece.blocks_received++;
+    if (std::find(piece.peers.begin(), piece.peers.end(), peer) == piece.peers.end())
+    {
+        piece.peers.push_back(peer);
+    }
+
+    // the map never moves its elements, the data stays in place until the piece is complete
+    return piece.data.data() + begin;
+}
+
+void BlockScheduler::finish_block(uint32_t index, uint32_t begin, const PieceCallback &on_piece)
+{
+    Shard &shard = this->shards[this->piece_shards[index].load(std::memory_order_acquire)];
+    size_t block_index = begin / RequestWindow::BLOCK_SIZE;
+
+    PieceBuffer piece_data;
+    std::optional<Sha1Digest> digest;
+    std::vector<std::string> peers;
+    {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+        PartialPiece &piece = shard.pieces.at(index);
+
+        set_bit(piece.written, block_index);
+        piece.blocks_written++;
+        this->drop_request(piece, block_index);
+
+        if (this->incremental_hashing && !piece.out_of_order)
+        {
+            // only a block landing right after the prefix is hashed here, once one lands past it the prefix can't
+            // reach the end anymore and the pool hashes the piece whole, the event loop never catches up on a backlog
+            if (block_index == piece.hash_claimed)
+            {
+                piece.hash_claimed++;
+            }
+            else
+            {
+                piece.out_of_order = true;
+            }
+        }
+
+        if (this->incremental_hashing && !piece.hashing)
+        {
+            // hashed without the lock: the claimed blocks are written and only one session hashes a piece at a time,
+            // blocks other sessions claim meanwhile are picked up on the next round
+            piece.hashing = true;
+            while (piece.hashed_blocks < piece.hash_claimed && !piece.out_of_order)
+            {
+                size_t first = piece.hashed_blocks;
+                size_t end = piece.hash_claimed;
+                const uint8_t *data = piece.data.data() + first * RequestWindow::BLOCK_SIZE;
+                size_t length = std::min(end * RequestWindow::BLOCK_SIZE, piece.data.size()) - first * RequestWindow::BLOCK_SIZE;
+
+                lock.unlock();
+                piece.hasher.update(data, length);
+                lock.lock();
+
+                piece.hashed_blocks = end;
+            }
+            piece.hashing = false;
+        }
+
+        // while another session hashes the piece, it completes it once it is done
+        if (piece.blocks_written < piece.number_of_blocks || piece.hashing)
+        {
+            return;
+        }
+
+        if (this->incremental_hashing && piece.hashed_blocks == piece.number_of_blocks)
+        {
+            digest = piece.hasher.final();
+        }
+        piece_data = std::move(piece.data);
+        peers = std::move(piece.peers);
+        shard.pieces.erase(index);
+    }
+
+    on_piece(index, std::move(piece_data), digest, std::move(peers));
+}
+
+void BlockScheduler::abort_block(uint32_t index, uint32_t begin)
+{
+    Shard &shard = this->shards[this->piece_shards[index].load(std::memory_order_acquire)];
+    size_t block_index = begin / RequestWindow::BLOCK_SIZE;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // the block isn't received anymore, any peer may fetch it again once its request is released
+    auto it = shard.pieces.find(index);
+    PartialPiece &piece = it->second;
+    clear_bit(piece.received, block_index);
+    piece.blocks_received--;
+
+    // its request was released while the block was being received (its session closed), so nothing else frees it
+    if (!test_bit(piece.requested, block_index))
+    {
+        this->free_block(shard, it);
+    }
+}
+
+bool BlockScheduler::on_block(const BlockView &block, const std::string &peer, const PieceCallback &on_piece)
+{
+    uint8_t *destination = this->begin_block(block.index, block.begin, block.size, peer);
+    if (destination == nullptr)
+    {
+        // a duplicate still answers its request
+        this->release(block.index, block.begin);
+        return false;
+    }
+
+    // copied outside of the lock, other sessions keep claiming blocks meanwhile
+    std::copy(block.data, block.data + block.size, destination);
+    this->finish_block(block.index, block.begin, on_piece);
+    return true;
+}
+
+void BlockScheduler::release(uint32_t index, uint32_t begin)
+{
+    if (index >= this->piece_shards.size())
+    {
+        return;
+    }
+
+    Shard &shard = this->shards[this->piece_shards[index].load(std::memory_order_acquire)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.pieces.find(index);
+    if (it == shard.pieces.end())
+    {
+        return;
+    }
+
+    PartialPiece &piece = it->second;
+    size_t block_index = begin / RequestWindow::BLOCK_SIZE;
+    if (block_index >= piece.number_of_blocks)
+    {
+        return;
+    }
+
+    // endgame duplicates of the block may still be outstanding on other sessions, it stays requested until the last one is dropped
+    this->drop_request(piece, block_index);
+    if (test_bit(piece.received, block_index) || test_bit(piece.requested, block_index))
+    {
+        return;
+    }
+
+    this->free_block(shard, it);
+}
+
+void BlockScheduler::free_block(Shard &shard, std::map<size_t, PartialPiece>::iterator it)
+{
+    PartialPiece &piece = it->second;
+
+    // the owner left or choked us, let the other peers finish the piece
+    piece.owner = nullptr;
+
+    bool untouched = std::all_of(piece.requested.begin(), piece.requested.end(), [](uint64_t word)
+                                 { return word == 0; }) &&
+                     piece.blocks_received == 0;
+    if (untouched)
+    {
+        // let the picker choose again, possibly for a peer that has rarer pieces
+        size_t index = it->first;
+        shard.pieces.erase(it);
+        this->picker.release(index);
+    }
+}
+
+void BlockScheduler::set_single_source(size_t piece_index)
+{
+    if (piece_index < this->single_source.size())
+    {
+        this->single_source[piece_index].store(true);
+    }
+}
+
+bool BlockScheduler::is_endgame()
+{
+    return this->picker.is_endgame();
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "metainfo/metainfo.hpp"
+#include "messageHandler/message.hpp"
+#include "metainfo/sha1Engine.hpp"
+#include "client/bitfield.hpp"
+#include "client/pieceBufferPool.hpp"
+#include "client/piecePicker.hpp"
+#include "client/requestWindow.hpp"
+
+// Hands out the download one block at a time, so the blocks of a piece can be fetched from several peers at once.
+// A session first gets the free blocks of the pieces already started that its peer has, and starts the piece
+// the PiecePicker picks only when there are none, which keeps the number of partial pieces low.
+// Once every block is requested (endgame) a session is handed blocks other peers are still fetching,
+// so a slow peer holding the last blocks can't stall the download.
+// The started pieces are sharded, one shard per event loop: a session works on the pieces of its own shard
+// and steals from the other shards only when its own has nothing for it, so the loops rarely meet on a lock.
+// Blocks are copied (or received) into their piece, and hashed incrementally while they land in order, outside of the lock.
+// A piece is started only when the buffer pool has a buffer for it, so the pieces in flight stay within its memory limit.
+// A piece that failed verification with blocks from several peers is downloaded again from a single peer,
+// so the peer sending bad data can be told apart from the others.
+class BlockScheduler
+{
+public:
+    // called with a completed (not yet verified) piece, its digest if it was hashed incrementally, and the peers that sent its blocks
+    using PieceCallback = std::function<void(size_t piece_index, PieceBuffer piece_data, std::optional<Sha1Digest> digest, std::vector<std::string> peers)>;
+
+private:
+    struct PartialPiece
+    {
+        PieceBuffer data;
+        size_t number_of_blocks;
+        // block state bitmaps, a block is free when it is in neither
+        std::vector<uint64_t> requested;
+        std::vector<uint64_t> received;
+        // sessions each block is outstanding on (more than one in endgame), its requested bit is set while this isn't 0
+        std::vector<uint16_t> requesters;
+        // blocks copied into data, a block is received before it is written
+        std::vector<uint64_t> written;
+        size_t blocks_received;
+        size_t blocks_written;
+        // running hash over the blocks written in order, blocks [0, hashed_blocks)
+        Sha1Engine hasher;
+        size_t hashed_blocks;
+        // blocks [0, hash_claimed) were written in order, the ones past hashed_blocks are waiting for the hasher
+        size_t hash_claimed;
+        // a block was written past hash_claimed, the piece goes to the pool without a digest
+        bool out_of_order;
+        // a session is extending the hash outside of the lock, hasher is its alone until it is done
+        bool hashing;
+        // peers that sent blocks of the piece
+        std::vector<std::string> peers;
+        // the request window of the only session allowed to fetch the piece, nullptr if any session may
+        const RequestWindow *owner;
+    };
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::map<size_t, PartialPiece> pieces;
+    };
+
+    MetaInfo &metaInfo;
+    PiecePicker &picker;
+    PieceBufferPool &buffers;
+    bool incremental_hashing;
+    std::vector<Shard> shards;
+    // the shard each started piece is in
+    std::vector<std::atomic<uint32_t>> piece_shards;
+    // pieces to download from a single peer the next time they are started
+    std::vector<std::atomic<bool>> single_source;
+
+    /**
+     * @brief starts downloading a piece in a shard, called with the shard locked
+     *
+     * @param shard
+     * @param piece_index
+     * @param window the request window of the session starting the piece
+     * @param buffer the buffer the piece is downloaded into
+     * @return PartialPiece&
+     */
+    PartialPiece &start_piece(size_t shard, size_t piece_index, const RequestWindow &window, PieceBuffer buffer);
+
+    /**
+     * @brief claims a free block of the pieces of a shard the peer has, called with the shard locked
+     *
+     * @param shard
+     * @param bitfield
+     * @param window
+     * @param index
+     * @param block
+     * @return true if a block was claimed
+     * @return false
+     */
+    bool claim_free_block(size_t shard, const Bitfield &bitfield, const RequestWindow &window, uint32_t &index, size_t &block);
+
+    /**
+     * @brief finds a block of the pieces of a shard the peer has that is requested but not received yet
+     * and isn't outstanding on the peer, called with the shard locked
+     *
+     * @param shard
+     * @param bitfield
+     * @param window
+     * @param index
+     * @param block
+     * @return true if a block was found
+     * @return false
+     */
+    bool find_endgame_block(size_t shard, const Bitfield &bitfield, RequestWindow &window, uint32_t &index, size_t &block);
+
+    /**
+     * @brief counts a request of a block sent to a session, called with the shard locked
+     *
+     * @param piece
+     * @param block
+     */
+    void add_request(PartialPiece &piece, size_t block);
+
+    /**
+     * @brief uncounts a request of a block that is no longer outstanding on a session, called with the shard locked
+     *
+     * @param piece
+     * @param block
+     */
+    void drop_request(PartialPiece &piece, size_t block);
+
+    /**
+     * @brief called with the shard locked once a block is neither requested nor received anymore,
+     * any session may fetch the piece from then on, and a piece nothing is requested or received of goes back to the picker
+     *
+     * @param shard
+     * @param it the piece in the shard
+     */
+    void free_block(Shard &shard, std::map<size_t, PartialPiece>::iterator it);
+
+    /**
+     * @brief returns the length of a block of a piece
+     *
+     * @param piece_index
+     * @param block
+     * @return uint32_t
+     */
+    uint32_t get_block_length(size_t piece_index, size_t block);
+
+public:
+    /**
+     * @brief creates a scheduler starting the pieces picked by the picker
+     *
+     * @param metaInfo
+     * @param picker
+     * @param buffers the pool the piece buffers are taken from
+     * @param number_of_shards usually the number of event loops
+     * @param incremental_hashing hash the blocks of a piece as the prefix written in order grows, so a piece whose blocks
+     * all landed in order comes with its digest
+     */
+    BlockScheduler(MetaInfo &metaInfo, PiecePicker &picker, PieceBufferPool &buffers, size_t number_of_shards = 1, bool incremental_hashing = false);
+
+    BlockScheduler(const BlockScheduler &) = delete;
+    BlockScheduler &operator=(const BlockScheduler &) = delete;
+
+    /**
+     * @brief picks the next block to request from a peer and marks it requested
+     *
+     * @param shard the shard of the session, pieces it starts go there
+     * @param bitfield the pieces of the peer
+     * @param window the requests outstanding on the peer, never handed out again to it
+     * @param index
+     * @param begin
+     * @param length
+     * @return true if a block was picked
+     * @return false if the peer has none of the blocks left, or no piece can be started until a buffer is handed back
+     */
+    bool next_block(size_t shard, const Bitfield &bitfield, RequestWindow &window, uint32_t &index, uint32_t &begin, uint32_t &length);
+
+    /**
+     * @brief claims a block about to be received and returns where its bytes go, so they can be received in place,
+     * finish_block() must be called once they are written, or abort_block() if they never will be
+     *
+     * @param index
+     * @param begin
+     * @param length
+     * @param peer the peer sending the block
+     * @return uint8_t* the destination of the block in its piece, nullptr if it was received before
+     * (e.g. a duplicate from endgame) or its piece isn't downloaded anymore
+     */
+    uint8_t *begin_block(uint32_t index, uint32_t begin, uint32_t length, const std::string &peer);
+
+    /**
+     * @brief marks a block claimed by begin_block() as written and its request as answered,
+     * calls on_piece with the piece data once all of its blocks are, along with its digest if it was hashed incrementally
+     *
+     * @param index
+     * @param begin
+     * @param on_piece
+     */
+    void finish_block(uint32_t index, uint32_t begin, const PieceCallback &on_piece);
+
+    /**
+     * @brief gives up a block claimed by begin_block() that won't be written, e.g. because its peer left mid-block,
+     * the block can be requested again once its request is released, right away if it was released already
+     *
+     * @param index
+     * @param begin
+     */
+    void abort_block(uint32_t index, uint32_t begin);
+
+    /**
+     * @brief stores a received block and counts its request as answered, calls on_piece with the piece data
+     * once all of its blocks arrived, along with its digest if it was hashed incrementally
+     *
+     * @param block
+     * @param peer the peer that sent the block
+     * @param on_piece
+     * @return true if the block was new
+     * @return false if it was received before (e.g. a duplicate from endgame) or its piece isn't downloaded anymore
+     */
+    bool on_block(const BlockView &block, const std::string &peer, const PieceCallback &on_piece);
+
+    /**
+     * @brief drops a request of a block that won't be answered, e.g. because it was cancelled or its peer left or choked us,
+     * the block is free again once no session has it outstanding (endgame duplicates) and it wasn't received,
+     * a piece nothing was received or requested of goes back to the picker
+     *
+     * @param index
+     * @param begin
+     */
+    void release(uint32_t index, uint32_t begin);
+
+    /**
+     * @brief makes the next download of a piece come from a single peer, e.g. after it failed verification
+     * with blocks from several peers
+     *
+     * @param piece_index
+     */
+    void set_single_source(size_t piece_index);
+
+    /**
+     * @brief returns true once no piece is waiting to be started
+     *
+     * @return true
+     * @return false
+     */
+    bool is_endgame();
+};
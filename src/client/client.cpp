@@ -11,9 +11,18 @@
 #include <unistd.h>
 #include <cstdint>
 #include <algorithm>
-#include <queue>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <pthread.h>
+#include <csignal>
+#include <ctime>
+#include <atomic>
+#include <chrono>
+#include <sched.h>
 #include <mutex>
 #include <thread>
+#include <exception>
 
 #include <cpr/cpr.h>
 
@@ -21,12 +30,19 @@
 #include "bencode/decode.hpp"
 #include "messageHandler/messageHandler.hpp"
 #include "messageHandler/message.hpp"
-#include "metainfo/sha1.hpp"
+#include "metainfo/sha1Engine.hpp"
 #include "client/connection.hpp"
+#include "client/hashPool.hpp"
+#include "client/resumeFile.hpp"
+#include "storage/fileLayout.hpp"
 
 using namespace std::string_literals;
 
-std::vector<std::string> Client::discover_peers(MetaInfo metaInfo)
+Client::Client(ClientConfig config) : config(config), pieces_left(0), saver_stopping(false)
+{
+}
+
+std::vector<std::string> Client::discover_peers(MetaInfo &metaInfo)
 {
 
     cpr::Response r = cpr::Get(cpr::Url{metaInfo.get_announceURL()},
@@ -37,12 +53,12 @@ std::vector<std::string> Client::discover_peers(MetaInfo metaInfo)
                                    {"downloaded", "0"},
                                    {"left", std::to_string(metaInfo.get_file_size())},
                                    {"compact", "1"},
-                                   {"info_hash", metaInfo.get_info_string()}});
+                                   {"info_hash", std::string(metaInfo.get_info_string())}});
 
     return MessageHandler::parse_server_response(r.text);
 }
 
-std::string Client::get_peer_id(MetaInfo metaInfo, Connection &peerConnection)
+std::string Client::get_peer_id(MetaInfo &metaInfo, Connection &peerConnection)
 {
     std::vector<uint8_t> handshake_message = MessageHandler::create_handshake_message(metaInfo);
 
@@ -55,9 +71,9 @@ std::string Client::get_peer_id(MetaInfo metaInfo, Connection &peerConnection)
     return peer_id;
 }
 
-Connection Client::connect_to_peer(MetaInfo metaInfo, std::string peer_ip, std::string peer_port)
+Connection Client::connect_to_peer(MetaInfo &metaInfo, std::string peer_ip, std::string peer_port, Bitfield *bitfield)
 {
-    Connection peerConnection(peer_ip, peer_port);
+    Connection peerConnection(peer_ip, peer_port, false, this->config.timeouts.connect);
     std::string peerID = this->get_peer_id(metaInfo, peerConnection); // Handshake with the peer
 
     // Wait for a bitfield message from the peer indicating which pieces it has
@@ -67,6 +83,12 @@ Connection Client::connect_to_peer(MetaInfo metaInfo, std::string peer_ip, std::
         throw std::runtime_error("Expected BITFIELD(ID=5) message, but received message of ID: " + std::to_string(static_cast<int>(bitfield_response.get_type())));
     }
 
+    if (bitfield != nullptr)
+    {
+        std::vector<uint8_t> payload = bitfield_response.get_payload();
+        *bitfield = Bitfield::from_payload(payload.data(), payload.size(), metaInfo.get_number_of_pieces());
+    }
+
     // send interested message and wait for unchoke message
     std::vector<uint8_t> interested_message = MessageHandler::create_interested_message();
     peerConnection.send_message(interested_message);
@@ -80,19 +102,15 @@ Connection Client::connect_to_peer(MetaInfo metaInfo, std::string peer_ip, std::
     return peerConnection;
 }
 
-void Client::verify_piece(MetaInfo metaInfo, std::vector<uint8_t> piece_data, size_t piece_index)
+void Client::verify_piece(MetaInfo &metaInfo, const std::vector<uint8_t> &piece_data, size_t piece_index)
 {
-    auto sha = SHA1();
-
-    sha.update(std::string_view(reinterpret_cast<const char *>(piece_data.data()), piece_data.size()));
-
-    const auto calculated_piece_hash = sha.final();
+    const Sha1Digest calculated_piece_hash = Sha1Engine::hash(piece_data.data(), piece_data.size());
 
-    const auto expected_piece_hash = metaInfo.get_pieces_hash()[piece_index];
+    const PieceHash &expected_piece_hash = metaInfo.get_piece_hash(piece_index);
 
     if (calculated_piece_hash != expected_piece_hash)
     {
-        throw std::runtime_error("Piece hash verification failed, expected: " + expected_piece_hash + " but got: " + calculated_piece_hash);
+        throw std::runtime_error("Piece hash verification failed, expected: " + metaInfo.stringToHex(std::string(expected_piece_hash.begin(), expected_piece_hash.end())) + " but got: " + metaInfo.stringToHex(std::string(calculated_piece_hash.begin(), calculated_piece_hash.end())));
     }
 }
 
@@ -103,7 +121,7 @@ void Client::save_to_file(std::string output_file, std::vector<uint8_t> data)
     file.close();
 }
 
-void Client::download_piece(MetaInfo metaInfo, std::string output_file, size_t piece_index)
+void Client::download_piece(MetaInfo &metaInfo, std::string output_file, size_t piece_index)
 {
     std::vector<std::string> peers = this->discover_peers(metaInfo);
     if (peers.size() == 0)
@@ -112,7 +130,12 @@ void Client::download_piece(MetaInfo metaInfo, std::string output_file, size_t p
     std::string peer_ip = peers[0].substr(0, peers[0].find(":"));
     std::string peer_port = peers[0].substr(peers[0].find(":") + 1);
 
-    Connection peerConnection = connect_to_peer(metaInfo, peer_ip, peer_port);
+    Bitfield bitfield;
+    Connection peerConnection = connect_to_peer(metaInfo, peer_ip, peer_port, &bitfield);
+    if (!bitfield.has(piece_index))
+    {
+        throw std::runtime_error("Peer " + peers[0] + " does not have piece " + std::to_string(piece_index));
+    }
 
     // send a request message Wait for a piece message for each block
     std::vector<uint8_t> piece_data = peerConnection.fetch_piece_blocks(metaInfo, piece_index);
@@ -124,52 +147,406 @@ void Client::download_piece(MetaInfo metaInfo, std::string output_file, size_t p
     this->save_to_file(output_file, piece_data);
 }
 
-void Client::worker(MetaInfo metaInfo, const std::string peer_ip, const std::string peer_port)
+void Client::add_session(LoopContext &context, MetaInfo &metaInfo, const std::string &peer_ip, const std::string &peer_port)
 {
+    SessionCallbacks callbacks;
+    callbacks.on_bitfield = [this](const Bitfield &bitfield)
+    {
+        this->picker->add_peer(bitfield);
+    };
+    callbacks.on_have = [this](size_t piece_index)
+    {
+        this->picker->add_have(piece_index);
+    };
+    callbacks.on_piece = [this](size_t piece_index, PieceBuffer piece_data, std::optional<Sha1Digest> digest, std::vector<std::string> peers)
+    {
+        // hashing happens off the event loop unless the blocks were already hashed, the piece buffer is moved to the pool
+        this->hash_pool->submit(piece_index, std::move(piece_data), digest, [this, peers = std::move(peers)](size_t index, PieceBuffer data, bool valid)
+                                { this->complete_piece(index, data, valid, peers); });
+    };
+    callbacks.on_block = [this](uint32_t index, uint32_t begin, uint32_t)
+    {
+        // in endgame other peers may have been asked for the same block
+        if (this->picker->is_endgame())
+        {
+            this->cancel_block(index, begin);
+        }
+    };
+    callbacks.on_blocks_released = [this]()
+    {
+        this->wake_sessions();
+    };
+
+    callbacks.on_connected = [this](PeerSession &session)
+    {
+        if (!this->connections->on_established(session.get_address()))
+        {
+            session.disconnect("faster peers took all connection slots");
+        }
+    };
+    callbacks.on_closed = [this, &context, &metaInfo](PeerSession &session, const std::string &reason)
+    {
+        std::cerr << "Peer " << session.get_address() << " disconnected: " << reason << std::endl;
+        this->picker->remove_peer(session.get_bitfield());
+        this->connections->on_disconnected(session.get_address());
+        std::erase_if(context.sessions, [&](const std::shared_ptr<PeerSession> &candidate)
+                      { return candidate.get() == &session; });
+
+        // give the slot to the next candidate
+        this->connect_candidates(context, metaInfo);
+    };
+
     try
     {
-        Connection peerConnection = this->connect_to_peer(metaInfo, peer_ip, peer_port);
+        auto session = std::make_shared<PeerSession>(*context.engine, metaInfo, *this->scheduler, context.index, peer_ip, peer_port, callbacks, this->config.timeouts);
+        context.sessions.push_back(session);
+        session->start();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Failed to connect to " << peer_ip << ":" << peer_port << ": " << e.what() << std::endl;
+        this->connections->on_disconnected(peer_ip + ":" + peer_port);
+    }
+}
+
+void Client::connect_candidates(LoopContext &context, MetaInfo &metaInfo)
+{
+    std::string peer;
+    while (this->connections->next_candidate(peer))
+    {
+        this->add_session(context, metaInfo, peer.substr(0, peer.find(":")), peer.substr(peer.find(":") + 1));
+    }
+
+    this->schedule_racing(context, metaInfo);
+}
+
+void Client::schedule_racing(LoopContext &context, MetaInfo &metaInfo)
+{
+    if (context.racing)
+    {
+        return;
+    }
+
+    context.racing = true;
+    context.engine->add_timer(CONNECT_RACE_DELAY, [this, &context, &metaInfo]()
+                              {
+                                  context.racing = false;
+                                  this->race_slow_connects(context, metaInfo); });
+}
+
+void Client::race_slow_connects(LoopContext &context, MetaInfo &metaInfo)
+{
+    size_t slow = 0;
+    bool connecting = false;
+    for (auto &session : context.sessions)
+    {
+        SessionState state = session->get_state();
+        if (state == SessionState::CONNECTING || state == SessionState::HANDSHAKE)
+        {
+            connecting = true;
+            slow += session->get_connected_time() >= CONNECT_RACE_DELAY;
+        }
+    }
+
+    // the attempts started now race the slow ones, whichever completes the handshake first keeps the slot
+    std::string peer;
+    for (size_t i = 0; i < slow && this->connections->race_candidate(peer); ++i)
+    {
+        this->add_session(context, metaInfo, peer.substr(0, peer.find(":")), peer.substr(peer.find(":") + 1));
+        connecting = true;
+    }
+
+    if (connecting)
+    {
+        this->schedule_racing(context, metaInfo);
+    }
+}
+
+void Client::schedule_rebalance(LoopContext &context)
+{
+    context.engine->add_timer(REBALANCE_INTERVAL, [this, &context]()
+                              {
+                                  this->rebalance(context);
+
+                                  // a loop without sessions has nothing left to do, let it finish
+                                  if (!context.sessions.empty())
+                                  {
+                                      this->schedule_rebalance(context);
+                                  } });
+}
+
+void Client::rebalance(LoopContext &context)
+{
+    // measure every session, so the next round ranks them by their rate over one interval
+    std::shared_ptr<PeerSession> slowest;
+    double slowest_rate = 0;
+    for (auto &session : context.sessions)
+    {
+        double rate = session->measure_download_rate();
+        if (session->get_connected_time() >= REBALANCE_INTERVAL && (!slowest || rate < slowest_rate))
+        {
+            slowest = session;
+            slowest_rate = rate;
+        }
+    }
+
+    // all slots are taken while candidates wait, give the slowest peer's slot to one of them
+    if (slowest && this->connections->has_candidates())
+    {
+        slowest->disconnect("replaced by another peer, downloaded " + std::to_string(static_cast<uint64_t>(slowest_rate)) + " bytes/s");
+    }
+}
+
+void Client::ban_peer(const std::string &peer)
+{
+    for (auto &context : this->loops)
+    {
+        LoopContext *target = context.get();
+        target->engine->post([target, peer]()
+                             {
+                                 std::vector<std::shared_ptr<PeerSession>> sessions = target->sessions;
+                                 for (auto &session : sessions)
+                                 {
+                                     if (session->get_address() == peer)
+                                     {
+                                         session->disconnect("banned for sending corrupt data");
+                                     }
+                                 } });
+    }
+}
+
+void Client::release_pieces(const std::vector<size_t> &pieces)
+{
+    for (size_t piece_index : pieces)
+    {
+        this->picker->release(piece_index);
+    }
+
+    this->wake_sessions();
+}
+
+void Client::wake_sessions()
+{
+    // sessions that ran out of work only request again when woken up
+    for (auto &context : this->loops)
+    {
+        LoopContext *target = context.get();
+        target->engine->post([target]()
+                             {
+                                 std::vector<std::shared_ptr<PeerSession>> sessions = target->sessions;
+                                 for (auto &session : sessions)
+                                 {
+                                     session->request_blocks();
+                                 } });
+    }
+}
 
-        while (true)
+void Client::cancel_block(uint32_t index, uint32_t begin)
+{
+    for (auto &context : this->loops)
+    {
+        LoopContext *target = context.get();
+        target->engine->post([target, index, begin]()
+                             {
+                                 std::vector<std::shared_ptr<PeerSession>> sessions = target->sessions;
+                                 for (auto &session : sessions)
+                                 {
+                                     session->cancel_block(index, begin);
+                                 } });
+    }
+}
+
+void Client::complete_piece(size_t piece_index, const PieceBuffer &piece_data, bool valid, const std::vector<std::string> &peers)
+{
+    if (!valid)
+    {
+        if (peers.size() == 1)
         {
-            size_t piece_index;
+            bool banned = this->connections->on_hash_failure(peers.front());
+            std::cerr << "Piece " << piece_index << " from peer " << peers.front() << " failed hash verification (" << this->connections->get_hash_failures(peers.front()) << " bad pieces from this peer)" << std::endl;
+            if (banned)
             {
-                // get the next piece index from the work queue, if the queue is empty, then all pieces have been downloaded and the worker can exit
-                std::lock_guard<std::mutex> lock(work_queue_mutex);
-                if (work_queue.empty())
-                {
-                    break;
-                }
-                piece_index = work_queue.front();
-                work_queue.pop();
+                std::cerr << "Banning peer " << peers.front() << std::endl;
+                this->ban_peer(peers.front());
             }
+        }
+        else
+        {
+            // any of the peers may have sent the bad block, fetch the piece from one of them to find out which
+            std::cerr << "Piece " << piece_index << " from " << peers.size() << " peers failed hash verification, downloading it again from a single peer" << std::endl;
+            this->scheduler->set_single_source(piece_index);
+        }
 
-            try
+        // If the piece verification fails, let it be picked again
+        this->release_pieces({piece_index});
+        return;
+    }
+
+    if (!this->picker->mark_done(piece_index))
+    {
+        return;
+    }
+
+    try
+    {
+        this->storage->write_piece(piece_index, piece_data.data(), piece_data.size());
+    }
+    catch (const std::exception &e)
+    {
+        // a disk error won't go away by asking another peer, give up on the download
+        std::cerr << e.what() << std::endl;
+        for (auto &context : this->loops)
+        {
+            context->engine->stop();
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->completed_mutex);
+        this->completed.set(piece_index);
+    }
+
+    if (--this->pieces_left == 0)
+    {
+        for (auto &context : this->loops)
+        {
+            context->engine->stop();
+        }
+    }
+}
+
+void Client::restore_piece(size_t piece_index)
+{
+    if (!this->picker->mark_done(piece_index))
+    {
+        return;
+    }
+
+    // the piece is in the files already, the storage only has to know about it
+    this->storage->mark_piece_written(piece_index);
+
+    {
+        std::lock_guard<std::mutex> lock(this->completed_mutex);
+        this->completed.set(piece_index);
+    }
+    this->pieces_left--;
+}
+
+void Client::resume_download(MetaInfo &metaInfo, ResumeFile &resume, const std::vector<FileState> &file_states)
+{
+    Bitfield recorded;
+    std::vector<FileState> recorded_states;
+    if (!resume.load(metaInfo, recorded, recorded_states))
+    {
+        return;
+    }
+
+    // a piece is trusted if none of the files it lies in changed since its progress was recorded
+    FileLayout layout(metaInfo.get_files());
+    std::vector<size_t> changed_pieces;
+    size_t unchanged_pieces = 0;
+    for (size_t i = 0; i < metaInfo.get_number_of_pieces(); ++i)
+    {
+        if (!recorded.has(i))
+        {
+            continue;
+        }
+
+        std::vector<FileSpan> spans = layout.get_spans(static_cast<uint64_t>(i) * metaInfo.get_piece_length(), metaInfo.get_piece_length(i));
+        bool unchanged = std::all_of(spans.begin(), spans.end(), [&](const FileSpan &span)
+                                     { return file_states[span.file_index] == recorded_states[span.file_index]; });
+        if (unchanged)
+        {
+            this->restore_piece(i);
+            unchanged_pieces++;
+        }
+        else
+        {
+            changed_pieces.push_back(i);
+        }
+    }
+
+    // the pieces in changed files are read back and verified on the hashing threads before they count
+    std::atomic<size_t> valid_pieces = 0;
+    for (size_t piece_index : changed_pieces)
+    {
+        PieceBuffer buffer;
+        if (!this->piece_buffers->acquire(buffer))
+        {
+            // every buffer is queued for hashing, they are all back once the queue is empty
+            this->hash_pool->wait();
+            this->piece_buffers->acquire(buffer);
+        }
+
+        buffer.resize(metaInfo.get_piece_length(piece_index));
+        this->storage->read_piece(piece_index, [&buffer](const uint8_t *piece_data, size_t size)
+                                  { std::copy(piece_data, piece_data + size, buffer.data()); });
+
+        this->hash_pool->submit(piece_index, std::move(buffer), std::nullopt, [this, &valid_pieces](size_t index, PieceBuffer, bool valid)
+                                {
+                                    if (valid)
+                                    {
+                                        this->restore_piece(index);
+                                        valid_pieces++;
+                                    } });
+    }
+    this->hash_pool->wait();
+
+    std::cerr << "Resuming from " << resume.get_path() << ": " << unchanged_pieces << " pieces unchanged, "
+              << valid_pieces << " of " << changed_pieces.size() << " pieces in changed files verified" << std::endl;
+}
+
+void Client::save_resume(MetaInfo &metaInfo, ResumeFile &resume, const std::vector<std::string> &paths)
+{
+    // only pieces written before the sync are recorded, their data is on the disk when the resume file is
+    Bitfield completed;
+    {
+        std::lock_guard<std::mutex> lock(this->completed_mutex);
+        completed = this->completed;
+    }
+
+    this->storage->sync();
+    resume.save(metaInfo, completed, ResumeFile::stat_files(paths));
+}
+
+void Client::run_resume_saver(MetaInfo &metaInfo, ResumeFile &resume, const std::vector<std::string> &paths)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+
+    auto last_save = std::chrono::steady_clock::now();
+    while (!this->saver_stopping)
+    {
+        timespec timeout{0, std::chrono::nanoseconds(RESUME_SAVER_POLL_INTERVAL).count()};
+        if (sigtimedwait(&signals, nullptr, &timeout) > 0)
+        {
+            // the progress is saved once the loops wound down
+            std::cerr << "Interrupted, stopping the download" << std::endl;
+            for (auto &context : this->loops)
             {
-                std::vector<uint8_t> piece_data = peerConnection.fetch_piece_blocks(metaInfo, piece_index);
-                this->verify_piece(metaInfo, piece_data, piece_index);
+                context->engine->stop();
+            }
+        }
 
-                {
-                    std::lock_guard<std::mutex> lock(downloaded_pieces_mutex);
-                    downloaded_pieces[piece_index] = std::move(piece_data);
-                }
+        if (std::chrono::steady_clock::now() - last_save >= RESUME_INTERVAL)
+        {
+            try
+            {
+                this->save_resume(metaInfo, resume, paths);
             }
             catch (const std::exception &e)
             {
-                // If the piece download fails, add it back to the work queue
-                std::cerr << "Failed to download piece " << piece_index << ": " << e.what() << std::endl;
-                std::lock_guard<std::mutex> lock(work_queue_mutex);
-                work_queue.push(piece_index);
+                std::cerr << e.what() << std::endl;
             }
+            last_save = std::chrono::steady_clock::now();
         }
     }
-    catch (const std::exception &e)
-    {
-        std::cerr << "Worker failed: " << e.what() << std::endl;
-    }
 }
 
-void Client::download_file(MetaInfo metaInfo, std::string output_file)
+void Client::download_pieces(MetaInfo &metaInfo, ResumeFile &resume, const std::vector<std::string> &paths)
 {
     std::vector<std::string> peers = this->discover_peers(metaInfo);
     if (peers.empty())
@@ -177,35 +554,221 @@ void Client::download_file(MetaInfo metaInfo, std::string output_file)
         throw std::runtime_error("No peers found");
     }
 
-    for (size_t i = 0; i < metaInfo.get_pieces_hash().size(); ++i)
+    this->connections = std::make_unique<ConnectionManager>(this->config.max_peers, this->config.max_hash_failures);
+    this->connections->add_candidates(peers);
+
+    // spread the peers over the event loops, a loop only needs its own thread if there is more than one
+    size_t number_of_loops = std::clamp<size_t>(this->config.event_loops, 1, std::min(peers.size(), this->config.max_peers));
+    this->scheduler = std::make_unique<BlockScheduler>(metaInfo, *this->picker, *this->piece_buffers, number_of_loops, this->config.incremental_hashing);
+
+    for (size_t i = 0; i < number_of_loops; ++i)
+    {
+        auto context = std::make_unique<LoopContext>();
+        context->index = i;
+        context->engine = IoEngine::create(this->config.io_backend);
+        this->loops.push_back(std::move(context));
+    }
+
+    // sessions that found no buffer for a new piece went idle, wake them up once one is handed back
+    this->piece_buffers->set_on_available([this]()
+                                          { this->wake_sessions(); });
+
+    // fill the connection slots, candidates replace the peers that fail later on
+    std::string peer;
+    for (size_t i = 0; this->connections->next_candidate(peer); ++i)
     {
-        work_queue.push(i);
+        this->add_session(*this->loops[i % number_of_loops], metaInfo, peer.substr(0, peer.find(":")), peer.substr(peer.find(":") + 1));
     }
-    downloaded_pieces.resize(metaInfo.get_pieces_hash().size());
 
-    const int num_threads = std::min(static_cast<int>(peers.size()), 5); // Limit to 5 threads or number of peers
-    std::vector<std::thread> threads;
-    for (int i = 0; i < num_threads; ++i)
+    for (auto &context : this->loops)
     {
-        std::string peer_ip = peers[i].substr(0, peers[i].find(":"));
-        std::string peer_port = peers[i].substr(peers[i].find(":") + 1);
-        threads.emplace_back(&Client::worker, this, metaInfo, peer_ip, peer_port); // Start a worker thread
+        this->schedule_racing(*context, metaInfo);
+        this->schedule_rebalance(*context);
     }
 
-    // Wait for all threads to finish
-    for (auto &thread : threads)
+    // SIGINT and SIGTERM are taken by the resume saver while the loops run, so an interrupted download saves its progress,
+    // the loop threads inherit the mask
+    sigset_t signals;
+    sigset_t previous_signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+
+    this->saver_stopping = false;
+    std::thread resume_saver;
+    try
     {
-        if (thread.joinable())
+        resume_saver = std::thread([this, &metaInfo, &resume, &paths]()
+                                   { this->run_resume_saver(metaInfo, resume, paths); });
+    }
+    catch (...)
+    {
+        pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+        throw;
+    }
+
+    // a loop that fails stops the others, the failure is rethrown once everything wound down
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    auto fail = [this, &failure, &failure_mutex]()
+    {
+        std::lock_guard<std::mutex> lock(failure_mutex);
+        if (!failure)
+        {
+            failure = std::current_exception();
+        }
+        for (auto &context : this->loops)
+        {
+            context->engine->stop();
+        }
+    };
+    auto run_loop = [this, &fail](size_t i)
+    {
+        try
+        {
+            this->loops[i]->engine->run();
+        }
+        catch (...)
+        {
+            fail();
+        }
+    };
+
+    if (number_of_loops == 1)
+    {
+        run_loop(0);
+    }
+    else
+    {
+        unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> threads;
+        try
+        {
+            for (size_t i = 0; i < number_of_loops; ++i)
+            {
+                threads.emplace_back([this, i, cores, &run_loop]()
+                                     {
+                                         // pin each loop to its own core so its sessions stay cache-hot
+                                         cpu_set_t cpu_set;
+                                         CPU_ZERO(&cpu_set);
+                                         CPU_SET(i % cores, &cpu_set);
+                                         pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+
+                                         run_loop(i); });
+            }
+        }
+        catch (...)
+        {
+            fail();
+        }
+
+        // Wait for all loops to finish
+        for (auto &thread : threads)
+        {
             thread.join();
+        }
     }
 
-    // Concatenate all the pieces into a single data vector
-    std::vector<uint8_t> data;
-    for (const auto &piece : downloaded_pieces)
+    // the saver stops the loops on a signal, it has to be gone before they are
+    this->saver_stopping = true;
+    resume_saver.join();
+
+    // a signal that came in after the saver stopped would end the process once unblocked, the loops stopped anyway
+    timespec no_wait{0, 0};
+    while (sigtimedwait(&signals, nullptr, &no_wait) > 0)
     {
-        data.insert(data.end(), piece.begin(), piece.end());
     }
+    pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
 
-    // Save the data to the output file
-    save_to_file(output_file, data);
+    // pieces still being hashed may complete the download, and their results touch the loops
+    this->hash_pool->wait();
+    this->piece_buffers->set_on_available(nullptr);
+
+    for (auto &context : this->loops)
+    {
+        for (auto &session : context->sessions)
+        {
+            session->close();
+        }
+    }
+    this->loops.clear();
+    this->scheduler.reset();
+
+    if (failure)
+    {
+        std::rethrow_exception(failure);
+    }
+}
+
+void Client::download_file(MetaInfo &metaInfo, std::string output_file)
+{
+    size_t number_of_pieces = metaInfo.get_number_of_pieces();
+    this->picker = std::make_unique<PiecePicker>(number_of_pieces);
+    this->completed = Bitfield(number_of_pieces);
+    pieces_left = number_of_pieces;
+
+    // the files are looked at before they are opened, opening them may touch their mtime
+    ResumeFile resume(output_file);
+    std::vector<std::string> paths = Storage::get_file_paths(metaInfo, output_file);
+    std::vector<FileState> file_states = ResumeFile::stat_files(paths);
+
+    try
+    {
+        this->storage = Storage::create(this->config.storage_backend, metaInfo, output_file);
+        this->piece_buffers = std::make_unique<PieceBufferPool>(metaInfo.get_piece_length(), this->config.max_piece_memory);
+
+        // the hashing threads never take SIGINT or SIGTERM, once they are blocked for the download loops
+        // a signal must not find a thread that would let it end the process without saving the progress
+        sigset_t signals;
+        sigset_t previous_signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &signals, &previous_signals);
+        try
+        {
+            this->hash_pool = std::make_unique<HashPool>(metaInfo, this->config.hash_threads);
+        }
+        catch (...)
+        {
+            pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+            throw;
+        }
+        pthread_sigmask(SIG_SETMASK, &previous_signals, nullptr);
+
+        this->resume_download(metaInfo, resume, file_states);
+        if (pieces_left != 0)
+        {
+            this->download_pieces(metaInfo, resume, paths);
+        }
+
+        this->hash_pool.reset();
+        this->piece_buffers.reset();
+
+        this->save_resume(metaInfo, resume, paths);
+        this->storage.reset();
+    }
+    catch (...)
+    {
+        // keep the progress made before the failure, the next run continues from it
+        if (this->storage && this->hash_pool)
+        {
+            try
+            {
+                this->hash_pool->wait();
+                this->save_resume(metaInfo, resume, paths);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Failed to save the progress: " << e.what() << std::endl;
+            }
+        }
+        throw;
+    }
+
+    if (pieces_left != 0)
+    {
+        throw std::runtime_error("Download incomplete, " + std::to_string(pieces_left.load()) + " pieces missing");
+    }
 }
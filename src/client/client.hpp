@@ -6,34 +6,239 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
-#include <queue>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <map>
+#include <chrono>
 
 #include "metainfo/metainfo.hpp"
 #include "messageHandler/message.hpp"
 #include "client/connection.hpp"
+#include "client/ioEngine.hpp"
+#include "client/peerSession.hpp"
+#include "client/hashPool.hpp"
+#include "client/pieceBufferPool.hpp"
+#include "client/resumeFile.hpp"
+#include "client/piecePicker.hpp"
+#include "client/blockScheduler.hpp"
+#include "client/connectionManager.hpp"
+#include "client/bitfield.hpp"
+#include "storage/storage.hpp"
+
+struct ClientConfig
+{
+    // number of event loop threads the peer connections are spread over, each pinned to its own core
+    size_t event_loops = 1;
+    // I/O engine every event loop runs on
+    IoBackend io_backend = IoBackend::EPOLL;
+    // number of threads verifying completed pieces, 0 for one per core
+    size_t hash_threads = 0;
+    // hash the blocks of a piece on the event loop as they arrive in order instead of hashing whole pieces on the pool
+    bool incremental_hashing = false;
+    // number of peers kept connected, candidates from the tracker take the place of peers that fail or are too slow
+    size_t max_peers = 30;
+    // number of failed pieces a peer may send blocks of before it is banned
+    size_t max_hash_failures = 3;
+    // connect, handshake and idle timeouts of the peer connections
+    SessionTimeouts timeouts;
+    // bytes the buffers of the pieces being downloaded, verified and written may take together
+    size_t max_piece_memory = PieceBufferPool::DEFAULT_MEMORY_LIMIT;
+    // how verified pieces are written to the output file
+    StorageBackend storage_backend = StorageBackend::PWRITE;
+};
+
 class Client
 {
 private:
-    std::queue<size_t> work_queue;
-    std::mutex work_queue_mutex;
-    std::vector<std::vector<uint8_t>> downloaded_pieces;
-    std::mutex downloaded_pieces_mutex;
+    struct LoopContext
+    {
+        // also the scheduler shard of the loop
+        size_t index;
+        std::unique_ptr<IoEngine> engine;
+        std::vector<std::shared_ptr<PeerSession>> sessions;
+        // a timer to race the slow connects of the loop is pending
+        bool racing = false;
+    };
+
+    // how often each loop ranks its peers by download rate
+    static constexpr std::chrono::seconds REBALANCE_INTERVAL{30};
+    // how long a connect may take before another candidate is tried alongside it, as in happy eyeballs
+    static constexpr std::chrono::milliseconds CONNECT_RACE_DELAY{250};
+    // how often the progress is saved to the resume file while downloading
+    static constexpr std::chrono::seconds RESUME_INTERVAL{30};
+    // how long the resume saver waits for a signal before it checks whether to stop
+    static constexpr std::chrono::milliseconds RESUME_SAVER_POLL_INTERVAL{250};
+
+    ClientConfig config;
+    std::unique_ptr<PiecePicker> picker;
+    // declared before the scheduler and the hash pool, the buffers they hold go back to it
+    std::unique_ptr<PieceBufferPool> piece_buffers;
+    std::unique_ptr<BlockScheduler> scheduler;
+    std::unique_ptr<Storage> storage;
+    std::unique_ptr<HashPool> hash_pool;
+    std::unique_ptr<ConnectionManager> connections;
+    std::atomic<size_t> pieces_left;
+    std::atomic<bool> saver_stopping;
+    std::vector<std::unique_ptr<LoopContext>> loops;
+    // the pieces written to the output files, recorded in the resume file
+    Bitfield completed;
+    std::mutex completed_mutex;
+
+    /**
+     * @brief starts a peer session on the given loop
+     *
+     * @param context
+     * @param metaInfo
+     * @param peer_ip
+     * @param peer_port
+     */
+    void add_session(LoopContext &context, MetaInfo &metaInfo, const std::string &peer_ip, const std::string &peer_port);
+
+    /**
+     * @brief starts sessions on the given loop for candidates until the connection slots are full
+     *
+     * @param context
+     * @param metaInfo
+     */
+    void connect_candidates(LoopContext &context, MetaInfo &metaInfo);
+
+    /**
+     * @brief runs race_slow_connects() on the loop after CONNECT_RACE_DELAY unless it is scheduled already
+     *
+     * @param context
+     * @param metaInfo
+     */
+    void schedule_racing(LoopContext &context, MetaInfo &metaInfo);
+
+    /**
+     * @brief starts a session to another candidate for every session of the loop still connecting
+     * after CONNECT_RACE_DELAY, and checks again later while any session is connecting
+     *
+     * @param context
+     * @param metaInfo
+     */
+    void race_slow_connects(LoopContext &context, MetaInfo &metaInfo);
+
+    /**
+     * @brief runs rebalance() on the loop every REBALANCE_INTERVAL while it has sessions
+     *
+     * @param context
+     */
+    void schedule_rebalance(LoopContext &context);
+
+    /**
+     * @brief ranks the sessions of a loop by their download rate, and replaces the slowest by a candidate if there are any
+     *
+     * @param context
+     */
+    void rebalance(LoopContext &context);
+
+    /**
+     * @brief disconnects the sessions of a banned peer
+     *
+     * @param peer
+     */
+    void ban_peer(const std::string &peer);
+
+    /**
+     * @brief makes the sessions that ran out of work request blocks again
+     *
+     */
+    void wake_sessions();
+
+    /**
+     * @brief makes pieces wanted again and wakes up the sessions that ran out of work
+     *
+     * @param pieces
+     */
+    void release_pieces(const std::vector<size_t> &pieces);
+
+    /**
+     * @brief makes the sessions still waiting for a block cancel their request for it
+     *
+     * @param index
+     * @param begin
+     */
+    void cancel_block(uint32_t index, uint32_t begin);
+
+    /**
+     * @brief handles the verification result of a piece, called on a hashing thread: writes a valid piece
+     * to the output file, re-queues an invalid one and counts it against the peer that sent it,
+     * or has it fetched again from a single peer if several peers sent its blocks
+     *
+     * @param piece_index
+     * @param piece_data
+     * @param valid
+     * @param peers
+     */
+    void complete_piece(size_t piece_index, const PieceBuffer &piece_data, bool valid, const std::vector<std::string> &peers);
+
+    /**
+     * @brief counts a piece found on the disk as downloaded, safe to call from the hashing threads
+     *
+     * @param piece_index
+     */
+    void restore_piece(size_t piece_index);
+
+    /**
+     * @brief restores the progress recorded in the resume file: the pieces whose files are unchanged are counted
+     * right away, the ones in files changed since are read back and verified first
+     *
+     * @param metaInfo
+     * @param resume
+     * @param file_states the state of the output files before they were opened
+     */
+    void resume_download(MetaInfo &metaInfo, ResumeFile &resume, const std::vector<FileState> &file_states);
+
+    /**
+     * @brief syncs the written pieces to the disk and records them in the resume file
+     *
+     * @param metaInfo
+     * @param resume
+     * @param paths the output files
+     */
+    void save_resume(MetaInfo &metaInfo, ResumeFile &resume, const std::vector<std::string> &paths);
+
+    /**
+     * @brief saves the progress every RESUME_INTERVAL and stops the loops on SIGINT or SIGTERM, until saver_stopping is set
+     *
+     * @param metaInfo
+     * @param resume
+     * @param paths the output files
+     */
+    void run_resume_saver(MetaInfo &metaInfo, ResumeFile &resume, const std::vector<std::string> &paths);
+
+    /**
+     * @brief downloads the missing pieces from the peers the tracker returns, until they are all written or the loops are stopped
+     *
+     * @param metaInfo
+     * @param resume
+     * @param paths the output files
+     */
+    void download_pieces(MetaInfo &metaInfo, ResumeFile &resume, const std::vector<std::string> &paths);
 
 public:
+    /**
+     * @brief creates a client with the given configuration
+     *
+     * @param config
+     */
+    Client(ClientConfig config = ClientConfig());
+
     /**
      * @brief sends a get request to the tracker server to discover peers IP addresses
      *
      * @return std::vector<std::string>
      */
-    std::vector<std::string> discover_peers(MetaInfo metaInfo);
+    std::vector<std::string> discover_peers(MetaInfo &metaInfo);
 
     /**
      * @brief exchanges hanshake message with a peer and returns its id
      *
      * @return std::string
      */
-    std::string get_peer_id(MetaInfo metaInfo, Connection &peerConnection);
+    std::string get_peer_id(MetaInfo &metaInfo, Connection &peerConnection);
 
     /**
      * @brief initiates a connection with a peer to be ready for requesting pieces
@@ -41,9 +246,10 @@ public:
      * @param metaInfo
      * @param peer_ip
      * @param peer_port
+     * @param bitfield if not null, receives the pieces the peer has
      * @return Connection object
      */
-    Connection connect_to_peer(MetaInfo metaInfo, std::string peer_ip, std::string peer_port);
+    Connection connect_to_peer(MetaInfo &metaInfo, std::string peer_ip, std::string peer_port, Bitfield *bitfield = nullptr);
 
     /**
      * @brief verifies the piece by comparing its hash with the expected hash
@@ -52,7 +258,7 @@ public:
      * @param piece_data
      * @param piece_index
      */
-    void verify_piece(MetaInfo metaInfo, std::vector<uint8_t> piece_data, size_t piece_index);
+    void verify_piece(MetaInfo &metaInfo, const std::vector<uint8_t> &piece_data, size_t piece_index);
 
     /**
      * @brief saves the data to the output file
@@ -69,21 +275,15 @@ public:
      * @param output_file
      * @param piece_index
      */
-    void download_piece(MetaInfo metaInfo, std::string output_file, size_t piece_index);
-
-    /**
-     * @brief picks a piece from the work queue and downloads it from the peer
-     * @param metaInfo
-     * @param peer_ip
-     * @param peer_port
-     */
-    void worker(MetaInfo metaInfo, const std::string peer_ip, const std::string peer_port);
+    void download_piece(MetaInfo &metaInfo, std::string output_file, size_t piece_index);
 
     /**
-     * @brief downloads the entire file from available peers
+     * @brief downloads the entire file from all available peers, multiplexing the peer connections over the event loops,
+     * every piece is written to the output file once verified. The progress is kept in a resume file next to the output,
+     * a download started again with the same output continues from there
      *
      * @param metaInfo
      * @param output_file
      */
-    void download_file(MetaInfo metaInfo, std::string output_file);
-};
\ No newline at end of file
+    void download_file(MetaInfo &metaInfo, std::string output_file);
+};
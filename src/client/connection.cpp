@@ -2,17 +2,27 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <iostream>
+#include <functional>
+#include <optional>
+#include <string_view>
 
 #include "client/connection.hpp"
 #include "metainfo/metainfo.hpp"
 #include "messageHandler/message.hpp"
-#include "messageHandler/messageHandler.hpp"
+#include "messageHandler/messageWriter.hpp"
 
-Connection::Connection(const std::string &peer_ip, const std::string &peer_port)
+Connection::Connection(const std::string &peer_ip, const std::string &peer_port, bool non_blocking, std::chrono::milliseconds timeout)
 {
 
     // Create a TCP socket
@@ -23,20 +33,78 @@ Connection::Connection(const std::string &peer_ip, const std::string &peer_port)
     }
 
     // Resolve the peer address and port
-    sockaddr_in peerAddr;
-    peerAddr.sin_family = AF_INET;
-    peerAddr.sin_port = htons(std::stoi(peer_port));
-    inet_pton(AF_INET, peer_ip.c_str(), &peerAddr.sin_addr);
+    this->peerAddr = sockaddr_in{};
+    this->peerAddr.sin_family = AF_INET;
+    this->peerAddr.sin_port = htons(std::stoi(peer_port));
+    inet_pton(AF_INET, peer_ip.c_str(), &this->peerAddr.sin_addr);
 
-    // Connect
-    ssize_t iResult = connect(ConnectSocket, (struct sockaddr *)&peerAddr, sizeof(peerAddr));
-    if (iResult < 0)
+    this->sock = ConnectSocket;
+
+    if (non_blocking)
+    {
+        // the I/O engine connects the socket
+        fcntl(ConnectSocket, F_SETFL, fcntl(ConnectSocket, F_GETFL, 0) | O_NONBLOCK);
+        return;
+    }
+
+    try
+    {
+        this->connect_with_timeout(timeout);
+    }
+    catch (...)
     {
         close(ConnectSocket);
-        throw std::runtime_error("connect failed");
+        this->sock = 0;
+        throw;
     }
 
-    this->sock = ConnectSocket;
+    // an unresponsive peer makes recv/send fail with EAGAIN instead of blocking forever
+    timeval io_timeout{};
+    io_timeout.tv_sec = timeout.count() / 1000;
+    io_timeout.tv_usec = (timeout.count() % 1000) * 1000;
+    setsockopt(ConnectSocket, SOL_SOCKET, SO_RCVTIMEO, &io_timeout, sizeof(io_timeout));
+    setsockopt(ConnectSocket, SOL_SOCKET, SO_SNDTIMEO, &io_timeout, sizeof(io_timeout));
+}
+
+void Connection::connect_with_timeout(std::chrono::milliseconds timeout)
+{
+    int flags = fcntl(this->sock, F_GETFL, 0);
+    fcntl(this->sock, F_SETFL, flags | O_NONBLOCK);
+
+    ssize_t iResult = connect(this->sock, (struct sockaddr *)&this->peerAddr, sizeof(this->peerAddr));
+    if (iResult < 0 && errno != EINPROGRESS)
+    {
+        throw std::runtime_error("connect failed: " + std::string(std::strerror(errno)));
+    }
+
+    if (iResult < 0)
+    {
+        pollfd pending{this->sock, POLLOUT, 0};
+        int ready = poll(&pending, 1, static_cast<int>(timeout.count()));
+        if (ready < 0)
+        {
+            throw std::runtime_error("connect failed: " + std::string(std::strerror(errno)));
+        }
+        if (ready == 0)
+        {
+            throw std::runtime_error("connect timed out");
+        }
+
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(this->sock, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0)
+        {
+            throw std::runtime_error("connect failed: " + std::string(std::strerror(error)));
+        }
+    }
+
+    fcntl(this->sock, F_SETFL, flags);
+}
+
+Connection::Connection(Connection &&other) : sock(other.sock), peerAddr(other.peerAddr), pipeline(std::move(other.pipeline)), reader(std::move(other.reader)), output(std::move(other.output))
+{
+    other.sock = 0;
 }
 
 Connection::~Connection()
@@ -47,138 +115,225 @@ Connection::~Connection()
     }
 }
 
-void Connection::send_message(std::vector<uint8_t> message)
+int Connection::get_socket()
+{
+    return this->sock;
+}
+
+const sockaddr_in *Connection::get_peer_address()
+{
+    return &this->peerAddr;
+}
+
+void Connection::send_message(const std::vector<uint8_t> &message)
+{
+    this->send_bytes(message.data(), message.size());
+}
+
+void Connection::send_bytes(const uint8_t *data, size_t size)
 {
     if (this->sock == 0)
     {
         throw std::runtime_error("Socket not connected");
     }
 
-    ssize_t iResult = send(this->sock, message.data(), message.size(), 0);
-    if (iResult < 0)
+    size_t totalBytesSent = 0;
+    while (totalBytesSent < size)
     {
-        close(this->sock);
-        throw std::runtime_error("send failed");
+        ssize_t iResult = send(this->sock, data + totalBytesSent, size - totalBytesSent, MSG_NOSIGNAL);
+        if (iResult < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            throw std::runtime_error("send timed out");
+        }
+        if (iResult < 0)
+        {
+            throw std::runtime_error("send failed");
+        }
+        totalBytesSent += iResult;
     }
 }
 
-std::string Connection::receive_handshake_message()
+void Connection::flush_output()
 {
-    if (this->sock == 0)
+    if (this->output.empty())
     {
-        throw std::runtime_error("Socket not connected");
+        return;
     }
 
-    char buffer[1024];
-    ssize_t iResult = recv(this->sock, buffer, 1024, 0);
+    this->send_bytes(this->output.data(), this->output.size());
+    this->output.clear();
+}
+
+size_t Connection::receive_some(uint8_t *destination, size_t size)
+{
+    ssize_t iResult = recv(this->sock, destination, size, 0);
+    if (iResult < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        throw std::runtime_error("Peer did not send anything for too long");
+    }
     if (iResult < 0)
     {
-        close(this->sock);
         throw std::runtime_error("recv failed");
     }
+    if (iResult == 0)
+    {
+        throw std::runtime_error("Peer closed the connection");
+    }
 
-    return std::string(buffer, iResult);
+    return iResult;
 }
 
-Message Connection::receive_peer_message()
+void Connection::fill_reader()
 {
-
     if (this->sock == 0)
     {
         throw std::runtime_error("Socket not connected");
     }
 
-    uint32_t messageLength;
-    ssize_t iResult = recv(this->sock, &messageLength, sizeof(messageLength), 0);
-    if (iResult < 0)
+    uint8_t *position = this->reader.prepare();
+    this->reader.commit(this->receive_some(position, this->reader.writable_size()));
+}
+
+bool Connection::receive_block_in_place(const std::function<void(size_t, std::vector<uint8_t>, std::optional<Sha1Digest>)> &on_piece)
+{
+    BlockView received;
+    uint32_t block_length;
+    if (!this->reader.peek_partial_block(received, block_length))
     {
-        close(this->sock);
-        throw std::runtime_error("recv failed");
+        return false;
     }
 
-    messageLength = ntohl(messageLength);
-
-    uint8_t messageID;
-    iResult = recv(this->sock, &messageID, sizeof(messageID), 0);
-    if (iResult < 0)
+    uint8_t *destination = this->pipeline.get_block_destination(received.index, received.begin, block_length);
+    if (destination == nullptr)
     {
-        close(this->sock);
-        throw std::runtime_error("recv failed");
+        return false;
     }
 
-    // payload size (total message length - 1 byte for ID part)
-    size_t payloadSize = messageLength - 1;
+    // only the part that came in with the header is copied, the rest is received in place
+    std::copy(received.data, received.data + received.size, destination);
+    this->reader.consume_partial_block();
 
-    // Receive the payload
-    std::vector<uint8_t> payload(payloadSize);
-    size_t totalBytesRead = 0;
-    while (totalBytesRead < payloadSize)
+    for (size_t filled = received.size; filled < block_length;)
     {
-        ssize_t bytesRead = recv(this->sock, payload.data() + totalBytesRead, payloadSize - totalBytesRead, 0);
-        if (bytesRead <= 0)
-        {
-            throw std::runtime_error("Failed to receive complete payload");
-        }
-        totalBytesRead += bytesRead;
+        filled += this->receive_some(destination + filled, block_length - filled);
     }
 
-    return Message(static_cast<MessageType>(messageID), messageLength, payload);
+    this->pipeline.complete_block(received.index, received.begin, block_length, on_piece);
+    return true;
 }
 
-std::vector<uint8_t> Connection::fetch_piece_blocks(MetaInfo metaInfo, size_t piece_index)
+std::string Connection::receive_handshake_message()
 {
-    const uint32_t BLOCK_SIZE = 16 * 1024;
-    uint32_t block_index = 0;
-    uint32_t block_offset = 0;
-    uint32_t current_block_length = BLOCK_SIZE;
-
-    std::vector<std::string> pieces_hash = metaInfo.get_pieces_hash();
-    uint32_t piece_length;
-    if (piece_index >= pieces_hash.size())
+    // only the 68 handshake bytes are taken, messages that arrived with them stay buffered
+    std::string_view handshake;
+    while (!this->reader.next_handshake(handshake))
     {
-        throw std::runtime_error("Invalid piece index");
+        this->fill_reader();
     }
-    else if (piece_index == pieces_hash.size() - 1)
-    {
 
-        piece_length = metaInfo.get_file_size() % metaInfo.get_piece_length();
-    }
-    else
+    return std::string(handshake);
+}
+
+Message Connection::receive_peer_message()
+{
+    return this->receive_message_view().to_message();
+}
+
+MessageView Connection::receive_message_view()
+{
+    MessageView message;
+    while (!this->reader.next_message(message))
     {
-        piece_length = metaInfo.get_piece_length();
+        this->fill_reader();
     }
 
-    std::vector<uint8_t> piece_data(piece_length);
+    return message;
+}
+
+RequestWindow &Connection::get_request_window()
+{
+    return this->pipeline.get_request_window();
+}
+
+void Connection::fetch_pieces(MetaInfo &metaInfo, const std::function<bool(size_t &)> &next_piece, const std::function<void(size_t, std::vector<uint8_t>)> &on_piece)
+{
+    this->pipeline.reset();
 
-    while (block_index * BLOCK_SIZE < piece_length)
+    auto complete_piece = [&](size_t index, std::vector<uint8_t> data, std::optional<Sha1Digest>)
     {
-        // adjust block length for the last block
-        if (block_offset + BLOCK_SIZE > piece_length)
+        on_piece(index, std::move(data));
+    };
+
+    while (true)
+    {
+        this->pipeline.fill(metaInfo, next_piece, [&](uint32_t index, uint32_t begin, uint32_t length)
+                            { MessageWriter::write_request(this->output, index, begin, length); });
+        this->flush_output();
+
+        if (this->pipeline.is_idle())
         {
-            current_block_length = piece_length - block_offset;
+            break;
         }
 
-        std::vector<uint8_t> request_message = MessageHandler::create_request_message(piece_index, block_offset, current_block_length);
-        this->send_message(request_message);
+        // wait for the next message, unless the next block can be received in place first
+        MessageView response;
+        bool received_in_place = false;
+        while (!received_in_place && !this->reader.next_message(response))
+        {
+            received_in_place = this->receive_block_in_place(complete_piece);
+            if (!received_in_place)
+            {
+                this->fill_reader();
+            }
+        }
 
-        Message piece_response = this->receive_peer_message();
+        if (received_in_place)
+        {
+            continue;
+        }
 
-        if (piece_response.get_type() == MessageType::CHOKE)
+        if (response.type == MessageType::CHOKE)
         {
-            break;
+            std::vector<size_t> dropped = this->pipeline.reset();
+            throw std::runtime_error("Peer choked the connection with " + std::to_string(dropped.size()) + " pieces in progress");
         }
 
-        if (piece_response.get_type() != MessageType::PIECE)
+        if (response.type != MessageType::PIECE)
         {
-            throw std::runtime_error("Expected PIECE message(ID=7), but received message of ID: " + std::to_string(static_cast<int>(piece_response.get_type())) + " at block index: " + std::to_string(block_index) + " and block offset: " + std::to_string(block_offset) + " with length: " + std::to_string(current_block_length));
+            // HAVE, BITFIELD, UNCHOKE... don't affect the blocks in flight
+            continue;
         }
 
-        Block block = piece_response.get_block();
-        std::copy(block.data.begin(), block.data.end(), piece_data.begin() + block.begin);
+        this->pipeline.on_block(response.get_block(), complete_piece);
+    }
+}
 
-        block_index++;
-        block_offset += BLOCK_SIZE;
+std::vector<uint8_t> Connection::fetch_piece_blocks(MetaInfo &metaInfo, size_t piece_index)
+{
+    if (piece_index >= metaInfo.get_number_of_pieces())
+    {
+        throw std::runtime_error("Invalid piece index");
     }
 
+    bool requested = false;
+    std::vector<uint8_t> piece_data;
+
+    this->fetch_pieces(
+        metaInfo,
+        [&](size_t &index)
+        {
+            if (requested)
+            {
+                return false;
+            }
+            index = piece_index;
+            requested = true;
+            return true;
+        },
+        [&](size_t, std::vector<uint8_t> data)
+        {
+            piece_data = std::move(data);
+        });
+
     return piece_data;
-}
\ No newline at end of file
+}
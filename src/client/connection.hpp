@@ -4,26 +4,92 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <vector>
+#include <functional>
+#include <optional>
 
 #include "metainfo/metainfo.hpp"
 #include "messageHandler/message.hpp"
+#include "messageHandler/frameReader.hpp"
+#include "messageHandler/outputBuffer.hpp"
+#include "client/requestWindow.hpp"
+#include "client/piecePipeline.hpp"
 
 class Connection
 {
 private:
     int sock;
+    sockaddr_in peerAddr;
+    PiecePipeline pipeline;
+    FrameReader reader;
+    // messages serialized by MessageWriter, sent together by flush_output()
+    OutputBuffer output;
+
+    /**
+     * @brief sends all bytes over the socket
+     *
+     * @param data
+     * @param size
+     */
+    void send_bytes(const uint8_t *data, size_t size);
+
+    /**
+     * @brief sends the messages queued in the output buffer in one go
+     *
+     */
+    void flush_output();
+
+    /**
+     * @brief connects the blocking socket, giving up after the timeout instead of the OS default of minutes
+     *
+     * @param timeout
+     */
+    void connect_with_timeout(std::chrono::milliseconds timeout);
+
+    /**
+     * @brief receives up to size bytes from the socket, blocks until some bytes arrived or the timeout passed
+     *
+     * @param destination
+     * @param size
+     * @return size_t the number of bytes received
+     */
+    size_t receive_some(uint8_t *destination, size_t size);
+
+    /**
+     * @brief if the reader holds a partly received PIECE of a requested block, receives the rest of the block
+     * straight into its piece and hands it to the pipeline
+     *
+     * @param on_piece
+     * @return true if a block was received in place
+     * @return false
+     */
+    bool receive_block_in_place(const std::function<void(size_t, std::vector<uint8_t>, std::optional<Sha1Digest>)> &on_piece);
+
+    /**
+     * @brief reads from the socket into the frame reader
+     *
+     */
+    void fill_reader();
 
 public:
+    static constexpr std::chrono::milliseconds DEFAULT_TIMEOUT{10000};
+
     /**
-     * @brief creates a TCP connection with the peer
+     * @brief creates a TCP connection with the peer, a non-blocking socket is left unconnected for an I/O engine to connect
      *
      * @param peer_ip
      * @param peer_port
+     * @param non_blocking
+     * @param timeout how long a blocking socket waits for the connect and for every receive and send
      */
-    Connection(const std::string &peer_ip, const std::string &peer_port);
+    Connection(const std::string &peer_ip, const std::string &peer_port, bool non_blocking = false, std::chrono::milliseconds timeout = DEFAULT_TIMEOUT);
+
+    Connection(Connection &&other);
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
 
     /**
      * @brief destroys the TCP connection
@@ -31,12 +97,26 @@ public:
      */
     ~Connection();
 
+    /**
+     * @brief returns the socket file descriptor of the connection
+     *
+     * @return int
+     */
+    int get_socket();
+
+    /**
+     * @brief returns the address of the peer
+     *
+     * @return const sockaddr_in*
+     */
+    const sockaddr_in *get_peer_address();
+
     /**
      * @brief sends a message to the peer over the TCP connection
      *
      * @param message
      */
-    void send_message(std::vector<uint8_t> message);
+    void send_message(const std::vector<uint8_t> &message);
 
     /**
      * @brief receives handshake message from the peer over the TCP connection
@@ -53,10 +133,34 @@ public:
     Message receive_peer_message();
 
     /**
-     * @brief sends a request message and waits for a piece message for each block then returns all the blocks of a piece with the given index
+     * @brief receives a peer message without copying its payload out of the receive buffer
+     *
+     * @return MessageView valid until the next receive call
+     */
+    MessageView receive_message_view();
+
+    /**
+     * @brief returns the request window used to pipeline block requests, can be used to configure its limits
+     *
+     * @return RequestWindow&
+     */
+    RequestWindow &get_request_window();
+
+    /**
+     * @brief downloads pieces over a pipelined request window, blocks of the next piece are requested while the current one is still arriving,
+     * the requests filling the window are sent together
+     *
+     * @param metaInfo
+     * @param next_piece called whenever the window has room for a new piece, returns false when there are no more pieces to fetch
+     * @param on_piece called with the index and data of every completed piece
+     */
+    void fetch_pieces(MetaInfo &metaInfo, const std::function<bool(size_t &)> &next_piece, const std::function<void(size_t, std::vector<uint8_t>)> &on_piece);
+
+    /**
+     * @brief sends request messages for all blocks of the piece with the given index over the request window, then returns the assembled piece
      *
      * @param metaInfo
      * @return std::vector<uint8_t>
      */
-    std::vector<uint8_t> fetch_piece_blocks(MetaInfo metaInfo, size_t piece_index);
+    std::vector<uint8_t> fetch_piece_blocks(MetaInfo &metaInfo, size_t piece_index);
 };
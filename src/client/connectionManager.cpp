@@ -0,0 +1,127 @@
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "client/connectionManager.hpp"
+
+ConnectionManager::ConnectionManager(size_t max_peers, size_t max_hash_failures)
+{
+    this->max_peers = max_peers;
+    this->max_hash_failures = max_hash_failures;
+}
+
+void ConnectionManager::add_candidates(const std::vector<std::string> &peers)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (const std::string &peer : peers)
+    {
+        if (this->known.insert(peer).second)
+        {
+            this->candidates.push_back(peer);
+        }
+    }
+}
+
+bool ConnectionManager::take_candidate(size_t limit, std::string &peer)
+{
+    while (this->connected.size() < limit && !this->candidates.empty())
+    {
+        std::string candidate = std::move(this->candidates.front());
+        this->candidates.pop_front();
+
+        if (this->banned.contains(candidate) || this->connected.contains(candidate))
+        {
+            continue;
+        }
+
+        this->connected.insert(candidate);
+        this->connecting.insert(candidate);
+        peer = std::move(candidate);
+        return true;
+    }
+
+    return false;
+}
+
+bool ConnectionManager::next_candidate(std::string &peer)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->take_candidate(this->max_peers, peer);
+}
+
+bool ConnectionManager::race_candidate(std::string &peer)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->take_candidate(this->max_peers + MAX_RACING_ATTEMPTS, peer);
+}
+
+bool ConnectionManager::on_established(const std::string &peer)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->connecting.erase(peer) == 0)
+    {
+        return this->connected.contains(peer);
+    }
+
+    if (this->connected.size() - this->connecting.size() <= this->max_peers)
+    {
+        return true;
+    }
+
+    // lost the race, the peer isn't to blame so it goes back to the candidates without counting a disconnect
+    this->connected.erase(peer);
+    this->candidates.push_back(peer);
+    return false;
+}
+
+void ConnectionManager::on_disconnected(const std::string &peer)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->connecting.erase(peer);
+    if (this->connected.erase(peer) == 0)
+    {
+        return;
+    }
+
+    if (!this->banned.contains(peer) && ++this->disconnects[peer] < MAX_DISCONNECTS)
+    {
+        this->candidates.push_back(peer);
+    }
+}
+
+bool ConnectionManager::on_hash_failure(const std::string &peer)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->banned.contains(peer))
+    {
+        return false;
+    }
+
+    if (++this->hash_failures[peer] < this->max_hash_failures)
+    {
+        return false;
+    }
+
+    this->banned.insert(peer);
+    return true;
+}
+
+size_t ConnectionManager::get_hash_failures(const std::string &peer)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->hash_failures.find(peer);
+    return it == this->hash_failures.end() ? 0 : it->second;
+}
+
+bool ConnectionManager::has_candidates()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return !this->candidates.empty();
+}
+
+size_t ConnectionManager::get_connected_count()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->connected.size();
+}
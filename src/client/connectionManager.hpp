@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Keeps track of the peers of a download: the candidates from the tracker waiting for a connection slot,
+// the connected peers, and the peers banned for sending pieces that failed verification.
+// Disconnected peers go back to the end of the candidates until they failed too often.
+// Connects that are slow to finish are raced by extra attempts to other candidates (happy eyeballs):
+// the first peers to complete the handshake take the slots, the attempts finishing after them are dropped.
+// Shared by the event loops and the hashing threads, every method locks.
+class ConnectionManager
+{
+private:
+    size_t max_peers;
+    size_t max_hash_failures;
+    std::deque<std::string> candidates;
+    std::set<std::string> known;
+    // peers holding or racing for a slot, and those of them that haven't completed the handshake yet
+    std::set<std::string> connected;
+    std::set<std::string> connecting;
+    std::set<std::string> banned;
+    // disconnects and hash failures by peer address
+    std::map<std::string, size_t> disconnects;
+    std::map<std::string, size_t> hash_failures;
+    std::mutex mutex;
+
+    /**
+     * @brief takes the next candidate that isn't banned or connected while fewer than limit peers are connected,
+     * called with the mutex locked
+     *
+     * @param limit
+     * @param peer
+     * @return true if a candidate was taken
+     * @return false
+     */
+    bool take_candidate(size_t limit, std::string &peer);
+
+public:
+    // a peer is dropped from the candidates after this many disconnects
+    static constexpr size_t MAX_DISCONNECTS = 3;
+    // number of attempts that may race the slow connects on top of max_peers
+    static constexpr size_t MAX_RACING_ATTEMPTS = 8;
+
+    /**
+     * @brief creates a manager that keeps up to max_peers peers connected
+     *
+     * @param max_peers
+     * @param max_hash_failures number of failed pieces a peer may take part in before it is banned
+     */
+    ConnectionManager(size_t max_peers, size_t max_hash_failures);
+
+    ConnectionManager(const ConnectionManager &) = delete;
+    ConnectionManager &operator=(const ConnectionManager &) = delete;
+
+    /**
+     * @brief adds peers (ip:port) to the candidates, peers seen before are skipped
+     *
+     * @param peers
+     */
+    void add_candidates(const std::vector<std::string> &peers);
+
+    /**
+     * @brief takes the next candidate if a connection slot is free and marks it connected
+     *
+     * @param peer
+     * @return true if a candidate was taken
+     * @return false if all slots are taken or there are no candidates left
+     */
+    bool next_candidate(std::string &peer);
+
+    /**
+     * @brief takes the next candidate to race a connect that is taking long, even if all slots are taken
+     *
+     * @param peer
+     * @return true if a candidate was taken
+     * @return false if too many attempts race already or there are no candidates left
+     */
+    bool race_candidate(std::string &peer);
+
+    /**
+     * @brief gives a slot to a peer that completed the handshake
+     *
+     * @param peer
+     * @return true if the peer got a slot
+     * @return false if faster peers took all slots, the peer becomes a candidate again and should be disconnected
+     */
+    bool on_established(const std::string &peer);
+
+    /**
+     * @brief frees the slot of a peer, it becomes a candidate again unless it is banned or disconnected too often
+     *
+     * @param peer
+     */
+    void on_disconnected(const std::string &peer);
+
+    /**
+     * @brief counts a failed piece against a peer that sent blocks of it
+     *
+     * @param peer
+     * @return true if the peer got banned by this failure
+     * @return false
+     */
+    bool on_hash_failure(const std::string &peer);
+
+    /**
+     * @brief returns the number of failed pieces the peer took part in
+     *
+     * @param peer
+     * @return size_t
+     */
+    size_t get_hash_failures(const std::string &peer);
+
+    /**
+     * @brief returns true if candidates are waiting for a slot
+     *
+     * @return true
+     * @return false
+     */
+    bool has_candidates();
+
+    /**
+     * @brief returns the number of connected peers, including connects in progress
+     *
+     * @return size_t
+     */
+    size_t get_connected_count();
+};
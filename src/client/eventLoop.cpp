@@ -0,0 +1,319 @@
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "client/eventLoop.hpp"
+
+EventLoop::EventLoop()
+{
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (this->epoll_fd < 0)
+    {
+        throw std::runtime_error("epoll_create1 failed: " + std::string(std::strerror(errno)));
+    }
+
+    this->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (this->wakeup_fd < 0)
+    {
+        close(this->epoll_fd);
+        throw std::runtime_error("eventfd failed: " + std::string(std::strerror(errno)));
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = this->wakeup_fd;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->wakeup_fd, &event);
+
+    this->stopped = false;
+}
+
+EventLoop::~EventLoop()
+{
+    close(this->wakeup_fd);
+    close(this->epoll_fd);
+}
+
+void EventLoop::connect(int fd, const sockaddr_in *address, IoCallback callback)
+{
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(address), sizeof(*address)) == 0)
+    {
+        this->completions.emplace_back(std::move(callback), 0);
+    }
+    else if (errno == EINPROGRESS)
+    {
+        // the connect completes once the socket becomes writable
+        this->watches[fd].connect_callback = std::move(callback);
+        this->dirty_watches.insert(fd);
+    }
+    else
+    {
+        this->completions.emplace_back(std::move(callback), -errno);
+    }
+}
+
+void EventLoop::read(int fd, uint8_t *buffer, size_t size, IoCallback callback)
+{
+    this->watches[fd].reads.push_back(PendingRead{buffer, size, std::move(callback)});
+    this->dirty_watches.insert(fd);
+}
+
+void EventLoop::write(int fd, const uint8_t *data, size_t size, IoCallback callback)
+{
+    auto watch = this->watches.find(fd);
+    if (watch == this->watches.end() || watch->second.writes.empty())
+    {
+        // the socket buffer usually has room, try without waiting for EPOLLOUT first
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            this->completions.emplace_back(std::move(callback), sent >= 0 ? sent : -errno);
+            return;
+        }
+    }
+
+    this->watches[fd].writes.push_back(PendingWrite{data, size, std::move(callback)});
+    this->dirty_watches.insert(fd);
+}
+
+void EventLoop::cancel(int fd)
+{
+    auto watch = this->watches.find(fd);
+    if (watch == this->watches.end())
+    {
+        return;
+    }
+
+    if (watch->second.registered_events != 0)
+    {
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    this->watches.erase(watch);
+    this->dirty_watches.erase(fd);
+}
+
+uint8_t *EventLoop::acquire_buffer(size_t size)
+{
+    return new uint8_t[size];
+}
+
+void EventLoop::release_buffer(uint8_t *buffer, size_t)
+{
+    delete[] buffer;
+}
+
+void EventLoop::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->posted_tasks_mutex);
+        this->posted_tasks.push_back(std::move(task));
+    }
+
+    uint64_t one = 1;
+    ssize_t iResult = ::write(this->wakeup_fd, &one, sizeof(one));
+    (void)iResult;
+}
+
+void EventLoop::add_timer(std::chrono::steady_clock::duration delay, std::function<void()> task)
+{
+    this->timers.add(delay, std::move(task));
+}
+
+void EventLoop::stop()
+{
+    this->post([this]()
+               { this->stopped = true; });
+}
+
+void EventLoop::run_posted_tasks()
+{
+    uint64_t count;
+    ssize_t iResult = ::read(this->wakeup_fd, &count, sizeof(count));
+    (void)iResult;
+
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(this->posted_tasks_mutex);
+        tasks.swap(this->posted_tasks);
+    }
+
+    for (auto &task : tasks)
+    {
+        task();
+    }
+}
+
+void EventLoop::run_completions()
+{
+    // callbacks may start new operations that complete immediately, those run on the next round
+    std::vector<std::pair<IoCallback, ssize_t>> ready;
+    ready.swap(this->completions);
+
+    for (auto &[callback, result] : ready)
+    {
+        callback(result);
+    }
+}
+
+void EventLoop::dispatch(int fd, uint32_t events)
+{
+    // a callback may cancel the socket, so the watch is looked up again after every callback
+    auto watch = this->watches.find(fd);
+
+    if (watch != this->watches.end() && watch->second.connect_callback && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+        IoCallback callback = std::move(watch->second.connect_callback);
+        watch->second.connect_callback = nullptr;
+        this->dirty_watches.insert(fd);
+        callback(-error);
+        return;
+    }
+
+    while (watch != this->watches.end() && !watch->second.writes.empty() && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+    {
+        PendingWrite &pending = watch->second.writes.front();
+        ssize_t sent = send(fd, pending.data, pending.size, MSG_NOSIGNAL);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+
+        IoCallback callback = std::move(pending.callback);
+        watch->second.writes.erase(watch->second.writes.begin());
+        this->dirty_watches.insert(fd);
+        callback(sent >= 0 ? sent : -errno);
+        watch = this->watches.find(fd);
+    }
+
+    while (watch != this->watches.end() && !watch->second.reads.empty() && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+    {
+        PendingRead &pending = watch->second.reads.front();
+        ssize_t received = recv(fd, pending.buffer, pending.size, 0);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+
+        IoCallback callback = std::move(pending.callback);
+        watch->second.reads.erase(watch->second.reads.begin());
+        this->dirty_watches.insert(fd);
+        callback(received >= 0 ? received : -errno);
+        watch = this->watches.find(fd);
+    }
+}
+
+void EventLoop::update_registrations()
+{
+    for (int fd : this->dirty_watches)
+    {
+        auto watch = this->watches.find(fd);
+        if (watch == this->watches.end())
+        {
+            continue;
+        }
+
+        uint32_t wanted = 0;
+        if (!watch->second.reads.empty())
+        {
+            wanted |= EPOLLIN;
+        }
+        if (watch->second.connect_callback || !watch->second.writes.empty())
+        {
+            wanted |= EPOLLOUT;
+        }
+
+        if (wanted == 0)
+        {
+            // a registered socket would keep reporting EPOLLHUP with nothing to wake up
+            if (watch->second.registered_events != 0)
+            {
+                epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+            }
+            this->watches.erase(watch);
+            continue;
+        }
+
+        if (wanted == watch->second.registered_events)
+        {
+            continue;
+        }
+
+        epoll_event event{};
+        event.events = wanted;
+        event.data.fd = fd;
+
+        int operation = (watch->second.registered_events == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        if (epoll_ctl(this->epoll_fd, operation, fd, &event) < 0)
+        {
+            throw std::runtime_error("epoll_ctl failed: " + std::string(std::strerror(errno)));
+        }
+        watch->second.registered_events = wanted;
+    }
+
+    this->dirty_watches.clear();
+}
+
+bool EventLoop::has_pending_work()
+{
+    if (!this->watches.empty() || !this->completions.empty())
+    {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(this->posted_tasks_mutex);
+    return !this->posted_tasks.empty();
+}
+
+void EventLoop::run()
+{
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+
+    while (!this->stopped)
+    {
+        this->run_completions();
+        this->timers.run_expired();
+        this->update_registrations();
+
+        if (this->stopped || !this->has_pending_work())
+        {
+            break;
+        }
+
+        // don't sleep while there are completions to deliver, nor past the next timer
+        int timeout = this->completions.empty() ? this->timers.get_timeout_ms() : 0;
+        int ready = epoll_wait(this->epoll_fd, events, MAX_EVENTS, timeout);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("epoll_wait failed: " + std::string(std::strerror(errno)));
+        }
+
+        for (int i = 0; i < ready && !this->stopped; ++i)
+        {
+            if (events[i].data.fd == this->wakeup_fd)
+            {
+                this->run_posted_tasks();
+                continue;
+            }
+
+            this->dispatch(events[i].data.fd, events[i].events);
+        }
+    }
+}
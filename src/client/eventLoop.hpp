@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "client/ioEngine.hpp"
+#include "client/timerQueue.hpp"
+
+// epoll backend of the IoEngine, operations are performed once their socket becomes ready
+class EventLoop : public IoEngine
+{
+private:
+    struct PendingRead
+    {
+        uint8_t *buffer;
+        size_t size;
+        IoCallback callback;
+    };
+
+    struct PendingWrite
+    {
+        const uint8_t *data;
+        size_t size;
+        IoCallback callback;
+    };
+
+    struct Watch
+    {
+        IoCallback connect_callback;
+        std::vector<PendingRead> reads;
+        std::vector<PendingWrite> writes;
+        uint32_t registered_events = 0;
+    };
+
+    int epoll_fd;
+    int wakeup_fd; // eventfd used to interrupt epoll_wait from other threads
+    bool stopped;
+    std::unordered_map<int, Watch> watches;
+    std::unordered_set<int> dirty_watches; // watches whose epoll registration must be updated
+    std::vector<std::pair<IoCallback, ssize_t>> completions; // operations that completed without waiting
+    TimerQueue timers;
+
+    std::mutex posted_tasks_mutex;
+    std::vector<std::function<void()>> posted_tasks;
+
+    /**
+     * @brief runs the tasks posted from other threads
+     *
+     */
+    void run_posted_tasks();
+
+    /**
+     * @brief runs the callbacks of the operations that completed immediately
+     *
+     */
+    void run_completions();
+
+    /**
+     * @brief performs the pending operations of a socket that became ready
+     *
+     * @param fd
+     * @param events
+     */
+    void dispatch(int fd, uint32_t events);
+
+    /**
+     * @brief brings the epoll registrations of the changed watches in line with their pending operations
+     *
+     */
+    void update_registrations();
+
+    /**
+     * @brief returns true if any operation or task is still pending
+     *
+     * @return true
+     * @return false
+     */
+    bool has_pending_work();
+
+public:
+    /**
+     * @brief creates an epoll instance for the loop
+     *
+     */
+    EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    /**
+     * @brief closes the epoll instance
+     *
+     */
+    ~EventLoop() override;
+
+    void connect(int fd, const sockaddr_in *address, IoCallback callback) override;
+    void read(int fd, uint8_t *buffer, size_t size, IoCallback callback) override;
+    void write(int fd, const uint8_t *data, size_t size, IoCallback callback) override;
+    void cancel(int fd) override;
+    uint8_t *acquire_buffer(size_t size) override;
+    void release_buffer(uint8_t *buffer, size_t size) override;
+    void post(std::function<void()> task) override;
+    void add_timer(std::chrono::steady_clock::duration delay, std::function<void()> task) override;
+    void stop() override;
+    void run() override;
+};
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "client/hashPool.hpp"
+#include "metainfo/sha1Engine.hpp"
+#include "metainfo/sha1MultiBuffer.hpp"
+
+HashPool::HashPool(MetaInfo &metaInfo, size_t number_of_threads) : metaInfo(metaInfo)
+{
+    this->lanes = Sha1MultiBuffer::is_preferred() ? Sha1MultiBuffer::get_lanes() : 1;
+    this->jobs_running = 0;
+    this->stopping = false;
+
+    if (number_of_threads == 0)
+    {
+        number_of_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < number_of_threads; ++i)
+    {
+        this->threads.emplace_back([this]()
+                                   { this->work(); });
+    }
+}
+
+HashPool::~HashPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->jobs_mutex);
+        this->stopping = true;
+    }
+    this->jobs_available.notify_all();
+
+    for (auto &thread : this->threads)
+    {
+        thread.join();
+    }
+}
+
+void HashPool::submit(size_t piece_index, PieceBuffer piece_data, std::optional<Sha1Digest> digest, Callback done)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->jobs_mutex);
+        this->jobs.push_back(Job{piece_index, std::move(piece_data), digest, std::move(done)});
+    }
+    this->jobs_available.notify_one();
+}
+
+void HashPool::wait()
+{
+    std::unique_lock<std::mutex> lock(this->jobs_mutex);
+    this->jobs_finished.wait(lock, [this]()
+                             { return this->jobs.empty() && this->jobs_running == 0; });
+}
+
+size_t HashPool::get_thread_count()
+{
+    return this->threads.size();
+}
+
+void HashPool::take_jobs(std::vector<Job> &batch)
+{
+    batch.push_back(std::move(this->jobs.front()));
+    this->jobs.pop_front();
+
+    const Job &first = batch.front();
+    if (this->lanes > 1 && !first.digest)
+    {
+        size_t size = first.piece_data.size();
+        auto can_join = [size](const Job &job)
+        { return !job.digest && job.piece_data.size() == size; };
+
+        // a partial group would hash no faster, leave those jobs to the other threads
+        if (static_cast<size_t>(std::count_if(this->jobs.begin(), this->jobs.end(), can_join)) + 1 >= this->lanes)
+        {
+            for (auto it = this->jobs.begin(); it != this->jobs.end() && batch.size() < this->lanes;)
+            {
+                if (can_join(*it))
+                {
+                    batch.push_back(std::move(*it));
+                    it = this->jobs.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    this->jobs_running += batch.size();
+}
+
+void HashPool::work()
+{
+    std::vector<Job> batch;
+    std::vector<const uint8_t *> data;
+    std::vector<Sha1Digest> digests;
+
+    while (true)
+    {
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(this->jobs_mutex);
+            this->jobs_available.wait(lock, [this]()
+                                      { return this->stopping || !this->jobs.empty(); });
+
+            // queued pieces are still verified when stopping
+            if (this->jobs.empty())
+            {
+                return;
+            }
+
+            this->take_jobs(batch);
+        }
+
+        if (!batch.front().digest)
+        {
+            // a batch holds only pieces of the same length that still need hashing
+            data.clear();
+            for (const Job &job : batch)
+            {
+                data.push_back(job.piece_data.data());
+            }
+            digests.resize(batch.size());
+            Sha1MultiBuffer::hash(data.data(), batch.size(), batch.front().piece_data.size(), digests.data());
+
+            for (size_t i = 0; i < batch.size(); ++i)
+            {
+                batch[i].digest = digests[i];
+            }
+        }
+
+        for (Job &job : batch)
+        {
+            bool valid = job.piece_index < this->metaInfo.get_number_of_pieces() && *job.digest == this->metaInfo.get_piece_hash(job.piece_index);
+            job.done(job.piece_index, std::move(job.piece_data), valid);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(this->jobs_mutex);
+            this->jobs_running -= batch.size();
+        }
+        this->jobs_finished.notify_all();
+    }
+}
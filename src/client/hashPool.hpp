@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "metainfo/metainfo.hpp"
+#include "metainfo/sha1Engine.hpp"
+#include "client/pieceBufferPool.hpp"
+
+// Threads that verify completed pieces against their hashes away from the event loops,
+// so a loop keeps servicing its sockets while multi-MB pieces are being hashed.
+// When enough pieces of the same length are queued, a thread takes a whole group and hashes it with the
+// multi-buffer kernel, which pays off when pieces arrive faster than they are verified (e.g. a recheck).
+class HashPool
+{
+public:
+    // called on a hashing thread with the piece data handed back and whether it matched its hash
+    using Callback = std::function<void(size_t piece_index, PieceBuffer piece_data, bool valid)>;
+
+private:
+    struct Job
+    {
+        size_t piece_index;
+        PieceBuffer piece_data;
+        std::optional<Sha1Digest> digest;
+        Callback done;
+    };
+
+    MetaInfo &metaInfo;
+    // pieces hashed together, 1 if the multi-buffer kernel isn't faster than hashing them one by one
+    size_t lanes;
+    std::vector<std::thread> threads;
+    std::deque<Job> jobs;
+    size_t jobs_running;
+    bool stopping;
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_available;
+    std::condition_variable jobs_finished;
+
+    /**
+     * @brief runs jobs until the pool is stopped
+     *
+     */
+    void work();
+
+    /**
+     * @brief takes the next job, with the queued jobs that can be hashed together with it if they fill a group
+     *
+     * @param batch receives the jobs, called with jobs_mutex held
+     */
+    void take_jobs(std::vector<Job> &batch);
+
+public:
+    /**
+     * @brief starts the hashing threads
+     *
+     * @param metaInfo
+     * @param number_of_threads 0 for one per core
+     */
+    HashPool(MetaInfo &metaInfo, size_t number_of_threads = 0);
+
+    HashPool(const HashPool &) = delete;
+    HashPool &operator=(const HashPool &) = delete;
+
+    /**
+     * @brief finishes the queued jobs and joins the threads
+     *
+     */
+    ~HashPool();
+
+    /**
+     * @brief queues a piece for verification, its data is moved into the pool rather than copied
+     *
+     * @param piece_index
+     * @param piece_data
+     * @param digest the digest if it was already computed, only compared then
+     * @param done
+     */
+    void submit(size_t piece_index, PieceBuffer piece_data, std::optional<Sha1Digest> digest, Callback done);
+
+    /**
+     * @brief blocks until every submitted piece was verified and its callback returned
+     *
+     */
+    void wait();
+
+    /**
+     * @brief returns the number of hashing threads
+     *
+     * @return size_t
+     */
+    size_t get_thread_count();
+};
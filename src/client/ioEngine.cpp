@@ -0,0 +1,51 @@
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#include "client/ioEngine.hpp"
+#include "client/eventLoop.hpp"
+#include "client/uringEngine.hpp"
+
+std::unique_ptr<IoEngine> IoEngine::create(IoBackend backend)
+{
+    switch (backend)
+    {
+    case IoBackend::EPOLL:
+        return std::make_unique<EventLoop>();
+    case IoBackend::IO_URING:
+#ifdef BITTORRENT_IO_URING
+    {
+        std::unique_ptr<UringEngine> engine = std::make_unique<UringEngine>();
+        if (!engine->supports_cancel_by_fd())
+        {
+            // every event loop creates its own engine, warn once
+            static std::once_flag warning;
+            std::call_once(warning, []()
+                           { std::cerr << "io_uring can't cancel by file descriptor on this kernel (needs Linux 5.19 or later), using epoll instead" << std::endl; });
+            return std::make_unique<EventLoop>();
+        }
+        return engine;
+    }
+#else
+        throw std::runtime_error("io_uring support was not compiled in, reconfigure with -DBITTORRENT_IO_URING=ON");
+#endif
+    default:
+        throw std::runtime_error("Unknown I/O backend");
+    }
+}
+
+IoBackend IoEngine::parse_backend(const std::string &name)
+{
+    if (name == "epoll")
+    {
+        return IoBackend::EPOLL;
+    }
+    else if (name == "io_uring")
+    {
+        return IoBackend::IO_URING;
+    }
+
+    throw std::runtime_error("Unknown I/O engine: " + name + " (expected epoll or io_uring)");
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+enum class IoBackend
+{
+    EPOLL,
+    IO_URING
+};
+
+// called once an operation completes, with the number of bytes transferred or -errno
+using IoCallback = std::function<void(ssize_t)>;
+
+class IoEngine
+{
+public:
+    virtual ~IoEngine() = default;
+
+    /**
+     * @brief creates the engine for the given backend, throws if the backend is not available
+     *
+     * @param backend
+     * @return std::unique_ptr<IoEngine>
+     */
+    static std::unique_ptr<IoEngine> create(IoBackend backend);
+
+    /**
+     * @brief parses a backend name as given on the command line ("epoll" or "io_uring")
+     *
+     * @param name
+     * @return IoBackend
+     */
+    static IoBackend parse_backend(const std::string &name);
+
+    /**
+     * @brief connects the non-blocking socket to the address
+     *
+     * @param fd
+     * @param address must stay valid until the callback runs
+     * @param callback
+     */
+    virtual void connect(int fd, const sockaddr_in *address, IoCallback callback) = 0;
+
+    /**
+     * @brief receives up to size bytes from the socket, a result of 0 means the peer closed the connection
+     *
+     * @param fd
+     * @param buffer
+     * @param size
+     * @param callback
+     */
+    virtual void read(int fd, uint8_t *buffer, size_t size, IoCallback callback) = 0;
+
+    /**
+     * @brief sends up to size bytes on the socket, the data must stay valid until the callback runs
+     *
+     * @param fd
+     * @param data
+     * @param size
+     * @param callback
+     */
+    virtual void write(int fd, const uint8_t *data, size_t size, IoCallback callback) = 0;
+
+    /**
+     * @brief aborts the pending operations on the socket, their callbacks may not run anymore
+     *
+     * @param fd
+     */
+    virtual void cancel(int fd) = 0;
+
+    /**
+     * @brief returns a read buffer of the given size, registered with the kernel if the backend supports it
+     *
+     * @param size
+     * @return uint8_t*
+     */
+    virtual uint8_t *acquire_buffer(size_t size) = 0;
+
+    /**
+     * @brief gives back a buffer returned by acquire_buffer
+     *
+     * @param buffer
+     * @param size
+     */
+    virtual void release_buffer(uint8_t *buffer, size_t size) = 0;
+
+    /**
+     * @brief queues a task to run on the engine thread, can be called from any thread
+     *
+     * @param task
+     */
+    virtual void post(std::function<void()> task) = 0;
+
+    /**
+     * @brief runs a task on the engine thread once the delay has passed, must be called on the engine thread,
+     * pending timers alone don't keep run() going
+     *
+     * @param delay
+     * @param task
+     */
+    virtual void add_timer(std::chrono::steady_clock::duration delay, std::function<void()> task) = 0;
+
+    /**
+     * @brief asks the engine to return from run(), can be called from any thread
+     *
+     */
+    virtual void stop() = 0;
+
+    /**
+     * @brief runs completions until stop() is called or no operation is pending
+     *
+     */
+    virtual void run() = 0;
+};
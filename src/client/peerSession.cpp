@@ -0,0 +1,509 @@
+#include <arpa/inet.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "client/peerSession.hpp"
+#include "messageHandler/messageWriter.hpp"
+
+PeerSession::PeerSession(IoEngine &engine, MetaInfo &metaInfo, BlockScheduler &scheduler, size_t shard, const std::string &peer_ip, const std::string &peer_port, SessionCallbacks callbacks, SessionTimeouts timeouts)
+    : engine(engine), metaInfo(metaInfo), peer_ip(peer_ip), peer_port(peer_port), connection(peer_ip, peer_port, true), scheduler(scheduler), shard(shard), callbacks(std::move(callbacks)),
+      timeouts(timeouts), bitfield(metaInfo.get_number_of_pieces()), input(engine.acquire_buffer(INPUT_BUFFER_SIZE)), reader(input, INPUT_BUFFER_SIZE)
+{
+    this->state = SessionState::CONNECTING;
+    this->started_at = this->measured_at = std::chrono::steady_clock::now();
+    this->connected_at = this->received_at = this->started_at;
+    this->timeout_check_generation = 0;
+    this->bytes_since_measurement = 0;
+    this->write_pending = false;
+}
+
+PeerSession::~PeerSession()
+{
+    // the engine dropped the read into the block without running it
+    if (this->in_place_block)
+    {
+        this->scheduler.abort_block(this->in_place_block->index, this->in_place_block->begin);
+    }
+
+    this->engine.release_buffer(this->input, INPUT_BUFFER_SIZE);
+}
+
+void PeerSession::start()
+{
+    auto self = this->shared_from_this();
+    this->engine.connect(this->connection.get_socket(), this->connection.get_peer_address(), [self](ssize_t result)
+                         { self->guard([&]()
+                                       {
+                                           if (result < 0)
+                                           {
+                                               throw std::runtime_error("connect failed: " + std::string(std::strerror(-result)));
+                                           }
+
+                                           self->state = SessionState::HANDSHAKE;
+                                           self->connected_at = std::chrono::steady_clock::now();
+                                           self->schedule_timeout_check(self->timeouts.handshake);
+                                           MessageWriter::write_handshake(self->output, self->metaInfo);
+                                           self->flush();
+                                           self->start_read(); }); });
+
+    this->schedule_timeout_check(this->timeouts.connect);
+}
+
+void PeerSession::schedule_timeout_check(std::chrono::steady_clock::duration delay)
+{
+    std::weak_ptr<PeerSession> weak = this->weak_from_this();
+    uint64_t generation = ++this->timeout_check_generation;
+    this->engine.add_timer(delay, [weak, generation]()
+                           {
+                               auto self = weak.lock();
+                               if (self && self->timeout_check_generation == generation)
+                               {
+                                   self->check_timeout();
+                               } });
+}
+
+void PeerSession::check_timeout()
+{
+    if (this->state == SessionState::CLOSED)
+    {
+        return;
+    }
+
+    std::chrono::steady_clock::time_point deadline;
+    std::string reason;
+    switch (this->state)
+    {
+    case SessionState::CONNECTING:
+        deadline = this->started_at + this->timeouts.connect;
+        reason = "connect timed out";
+        break;
+    case SessionState::HANDSHAKE:
+        deadline = this->connected_at + this->timeouts.handshake;
+        reason = "handshake timed out";
+        break;
+    default:
+        deadline = this->received_at + this->timeouts.idle;
+        reason = "Peer sent nothing for too long";
+        break;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline)
+    {
+        this->fail(reason);
+        return;
+    }
+
+    // the state moved on or the peer was active, check again at the new deadline
+    this->schedule_timeout_check(deadline - now);
+}
+
+SessionState PeerSession::get_state()
+{
+    return this->state;
+}
+
+std::string PeerSession::get_address()
+{
+    return this->peer_ip + ":" + this->peer_port;
+}
+
+double PeerSession::measure_download_rate()
+{
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - this->measured_at).count();
+    double rate = elapsed > 0 ? this->bytes_since_measurement / elapsed : 0;
+
+    this->measured_at = now;
+    this->bytes_since_measurement = 0;
+
+    return rate;
+}
+
+std::chrono::steady_clock::duration PeerSession::get_connected_time()
+{
+    return std::chrono::steady_clock::now() - this->started_at;
+}
+
+void PeerSession::disconnect(const std::string &reason)
+{
+    this->fail(reason);
+}
+
+const Bitfield &PeerSession::get_bitfield()
+{
+    return this->bitfield;
+}
+
+void PeerSession::guard(const std::function<void()> &step)
+{
+    if (this->state == SessionState::CLOSED)
+    {
+        return;
+    }
+
+    try
+    {
+        step();
+    }
+    catch (const std::exception &e)
+    {
+        this->fail(e.what());
+    }
+}
+
+void PeerSession::fail(const std::string &reason)
+{
+    if (this->state == SessionState::CLOSED)
+    {
+        return;
+    }
+
+    // the owner may drop its reference in on_closed
+    auto self = this->shared_from_this();
+    this->close();
+    this->callbacks.on_closed(*this, reason);
+}
+
+void PeerSession::close()
+{
+    if (this->state == SessionState::CLOSED)
+    {
+        return;
+    }
+
+    this->state = SessionState::CLOSED;
+    this->engine.cancel(this->connection.get_socket());
+    this->release_requests();
+}
+
+void PeerSession::release_requests()
+{
+    if (this->request_window.is_empty())
+    {
+        return;
+    }
+
+    for (const PendingRequest &request : this->request_window.get_outstanding())
+    {
+        this->scheduler.release(request.index, request.begin);
+    }
+    this->request_window.clear();
+
+    this->callbacks.on_blocks_released();
+}
+
+void PeerSession::flush()
+{
+    if (this->write_pending)
+    {
+        return;
+    }
+
+    if (this->sending.empty())
+    {
+        if (this->output.empty())
+        {
+            return;
+        }
+
+        // everything queued so far goes out in one write
+        std::swap(this->sending, this->output);
+    }
+
+    this->write_pending = true;
+
+    auto self = this->shared_from_this();
+    std::function<void(ssize_t)> on_written = [self](ssize_t result)
+    {
+        self->guard([&]()
+                    {
+                        if (result < 0)
+                        {
+                            throw std::runtime_error("send failed: " + std::string(std::strerror(-result)));
+                        }
+
+                        // after a short write the rest is sent before anything queued since
+                        self->sending.consume(result);
+                        self->write_pending = false;
+                        self->flush(); });
+    };
+
+    this->engine.write(this->connection.get_socket(), this->sending.data(), this->sending.size(), on_written);
+}
+
+void PeerSession::start_read()
+{
+    uint8_t *position;
+    size_t size;
+    if (this->in_place_block)
+    {
+        position = this->in_place_block->destination + this->in_place_block->received;
+        size = this->in_place_block->length - this->in_place_block->received;
+    }
+    else
+    {
+        position = this->reader.prepare();
+        size = this->reader.writable_size();
+    }
+
+    auto self = this->shared_from_this();
+    this->engine.read(this->connection.get_socket(), position, size, [self](ssize_t result)
+                      {
+                          self->guard([&]()
+                                      {
+                                          if (result < 0)
+                                          {
+                                              throw std::runtime_error("recv failed: " + std::string(std::strerror(-result)));
+                                          }
+                                          if (result == 0)
+                                          {
+                                              throw std::runtime_error("Peer closed the connection");
+                                          }
+
+                                          self->received_at = std::chrono::steady_clock::now();
+                                          if (self->in_place_block)
+                                          {
+                                              self->in_place_block->received += result;
+                                              if (self->in_place_block->received == self->in_place_block->length)
+                                              {
+                                                  self->finish_in_place_block();
+                                              }
+                                          }
+                                          else
+                                          {
+                                              self->reader.commit(result);
+                                          }
+                                          self->process_input();
+
+                                          if (self->state != SessionState::CLOSED)
+                                          {
+                                              self->start_read();
+                                          } });
+
+                          // the session closed, possibly while this read was still writing into a block
+                          if (self->state == SessionState::CLOSED)
+                          {
+                              self->abort_in_place_block();
+                          } });
+}
+
+void PeerSession::abort_in_place_block()
+{
+    if (!this->in_place_block)
+    {
+        return;
+    }
+
+    this->scheduler.abort_block(this->in_place_block->index, this->in_place_block->begin);
+    this->in_place_block.reset();
+    this->callbacks.on_blocks_released();
+}
+
+void PeerSession::process_input()
+{
+    while (this->state != SessionState::CLOSED)
+    {
+        if (this->state == SessionState::HANDSHAKE)
+        {
+            std::string_view handshake;
+            if (!this->reader.next_handshake(handshake))
+            {
+                break;
+            }
+
+            this->handle_handshake(handshake);
+            continue;
+        }
+
+        BlockView received;
+        uint32_t block_length;
+        if (this->state == SessionState::REQUESTING && this->reader.peek_partial_block(received, block_length) && this->start_in_place_block(received, block_length))
+        {
+            break;
+        }
+
+        MessageView message;
+        if (!this->reader.next_message(message))
+        {
+            break;
+        }
+
+        this->handle_message(message);
+    }
+}
+
+bool PeerSession::start_in_place_block(const BlockView &received, uint32_t block_length)
+{
+    if (this->scheduler.is_endgame() || !this->request_window.contains(received.index, received.begin))
+    {
+        return false;
+    }
+
+    uint8_t *destination = this->scheduler.begin_block(received.index, received.begin, block_length, this->get_address());
+    if (destination == nullptr)
+    {
+        return false;
+    }
+
+    // only the part that came in with the header is copied, the kernel writes the rest in place
+    std::copy(received.data, received.data + received.size, destination);
+    this->reader.consume_partial_block();
+    this->in_place_block = InPlaceBlock{received.index, received.begin, block_length, destination, received.size};
+
+    return true;
+}
+
+void PeerSession::finish_in_place_block()
+{
+    InPlaceBlock block = *this->in_place_block;
+    this->in_place_block.reset();
+
+    this->request_window.complete(block.index, block.begin, block.length);
+    this->bytes_since_measurement += block.length;
+    this->scheduler.finish_block(block.index, block.begin, this->callbacks.on_piece);
+    this->callbacks.on_block(block.index, block.begin, block.length);
+    this->request_blocks();
+}
+
+void PeerSession::handle_handshake(std::string_view handshake)
+{
+    const std::string_view PROTOCOL = "\x13"
+                                      "BitTorrent protocol";
+
+    if (handshake.substr(0, PROTOCOL.size()) != PROTOCOL)
+    {
+        throw std::runtime_error("Invalid handshake protocol string");
+    }
+
+    if (handshake.substr(28, 20) != this->metaInfo.get_info_string())
+    {
+        throw std::runtime_error("Handshake info hash does not match the torrent");
+    }
+
+    this->state = SessionState::BITFIELD;
+    this->callbacks.on_connected(*this);
+}
+
+void PeerSession::handle_message(const MessageView &message)
+{
+    if (this->state == SessionState::BITFIELD)
+    {
+        // the bitfield is optional for peers without pieces, any message moves us on
+        MessageWriter::write_signal(this->output, MessageType::INTERESTED);
+        this->flush();
+        this->state = SessionState::CHOKED;
+
+        if (message.type == MessageType::BITFIELD)
+        {
+            this->bitfield = Bitfield::from_payload(message.payload, message.payload_size, this->metaInfo.get_number_of_pieces());
+            this->callbacks.on_bitfield(this->bitfield);
+            return;
+        }
+    }
+
+    switch (message.type)
+    {
+    case MessageType::UNCHOKE:
+        if (this->state == SessionState::CHOKED)
+        {
+            this->state = SessionState::REQUESTING;
+            this->request_blocks();
+        }
+        break;
+
+    case MessageType::CHOKE:
+        if (this->state == SessionState::REQUESTING)
+        {
+            // the peer discards our requests when it chokes us, give the blocks back to the other peers
+            this->state = SessionState::CHOKED;
+            this->release_requests();
+        }
+        break;
+
+    case MessageType::HAVE:
+    {
+        size_t piece_index = message.get_have_index();
+        if (piece_index >= this->bitfield.get_size())
+        {
+            throw std::runtime_error("Peer announced invalid piece " + std::to_string(piece_index));
+        }
+
+        if (!this->bitfield.has(piece_index))
+        {
+            this->bitfield.set(piece_index);
+            this->callbacks.on_have(piece_index);
+            // the peer may now have a piece we want
+            this->request_blocks();
+        }
+        break;
+    }
+
+    case MessageType::PIECE:
+        if (this->state == SessionState::REQUESTING)
+        {
+            BlockView block = message.get_block();
+            // blocks we didn't ask for, or cancelled, are ignored
+            if (!this->request_window.complete(block.index, block.begin, block.size))
+            {
+                break;
+            }
+
+            this->bytes_since_measurement += block.size;
+            if (this->scheduler.on_block(block, this->get_address(), this->callbacks.on_piece))
+            {
+                this->callbacks.on_block(block.index, block.begin, block.size);
+            }
+            this->request_blocks();
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void PeerSession::request_blocks()
+{
+    this->guard([&]()
+                {
+                    if (this->state != SessionState::REQUESTING)
+                    {
+                        return;
+                    }
+
+                    uint32_t index, begin, length;
+                    while (!this->request_window.is_full() && this->scheduler.next_block(this->shard, this->bitfield, this->request_window, index, begin, length))
+                    {
+                        MessageWriter::write_request(this->output, index, begin, length);
+                        this->request_window.add(index, begin, length);
+                    }
+                    this->flush(); });
+}
+
+void PeerSession::cancel_block(uint32_t index, uint32_t begin)
+{
+    this->guard([&]()
+                {
+                    std::optional<PendingRequest> cancelled = this->request_window.remove(index, begin);
+                    if (!cancelled)
+                    {
+                        return;
+                    }
+
+                    MessageWriter::write_cancel(this->output, cancelled->index, cancelled->begin, cancelled->length);
+                    this->scheduler.release(cancelled->index, cancelled->begin);
+
+                    // request_blocks() flushes the cancel along with the requests filling the freed slot
+                    this->request_blocks(); });
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "metainfo/metainfo.hpp"
+#include "messageHandler/message.hpp"
+#include "messageHandler/frameReader.hpp"
+#include "messageHandler/outputBuffer.hpp"
+#include "client/connection.hpp"
+#include "client/ioEngine.hpp"
+#include "client/requestWindow.hpp"
+#include "client/blockScheduler.hpp"
+#include "client/bitfield.hpp"
+
+enum class SessionState
+{
+    CONNECTING, // connect in progress
+    HANDSHAKE,  // handshake sent, waiting for the peer's handshake
+    BITFIELD,   // waiting for the peer's bitfield
+    CHOKED,     // interested sent, waiting to be unchoked
+    REQUESTING, // unchoked, requesting blocks
+    CLOSED
+};
+
+// how long a session waits on the peer before giving up on it
+struct SessionTimeouts
+{
+    // for the TCP connect
+    std::chrono::milliseconds connect{10000};
+    // from the connect until the peer's handshake arrived
+    std::chrono::milliseconds handshake{10000};
+    // without receiving anything afterwards, peers send a keep-alive every two minutes
+    std::chrono::milliseconds idle{180000};
+};
+
+class PeerSession;
+
+struct SessionCallbacks
+{
+    // called with the pieces the peer has once it sent its bitfield
+    std::function<void(const Bitfield &)> on_bitfield;
+    // called with every piece the peer announces afterwards
+    std::function<void(size_t)> on_have;
+    // called with every completed (not yet verified) piece the session received the last block of
+    BlockScheduler::PieceCallback on_piece;
+    // called with (index, begin, length) of every new block received
+    std::function<void(uint32_t, uint32_t, uint32_t)> on_block;
+    // called when the session gave back blocks it requested but will not receive
+    std::function<void()> on_blocks_released;
+    // called once the peer's handshake was validated
+    std::function<void(PeerSession &)> on_connected;
+    // called once when the session fails or is disconnected, with the reason
+    std::function<void(PeerSession &, const std::string &)> on_closed;
+};
+
+class PeerSession : public std::enable_shared_from_this<PeerSession>
+{
+private:
+    // a block received straight into its piece instead of the input buffer
+    struct InPlaceBlock
+    {
+        uint32_t index;
+        uint32_t begin;
+        uint32_t length;
+        uint8_t *destination;
+        size_t received;
+    };
+
+    static constexpr size_t INPUT_BUFFER_SIZE = 256 * 1024;
+
+    IoEngine &engine;
+    MetaInfo &metaInfo;
+    std::string peer_ip;
+    std::string peer_port;
+    Connection connection;
+    SessionState state;
+    BlockScheduler &scheduler;
+    // the scheduler shard of the event loop the session runs on
+    size_t shard;
+    SessionCallbacks callbacks;
+    SessionTimeouts timeouts;
+    RequestWindow request_window;
+
+    // when the connect completed and when the peer last sent something, for the timeouts
+    std::chrono::steady_clock::time_point connected_at;
+    std::chrono::steady_clock::time_point received_at;
+    // only the latest scheduled timeout check runs, the earlier ones are stale
+    uint64_t timeout_check_generation;
+
+    // when the session started and the bytes received since the last rate measurement
+    std::chrono::steady_clock::time_point started_at;
+    std::chrono::steady_clock::time_point measured_at;
+    uint64_t bytes_since_measurement;
+    // the pieces the peer has, as reported to on_bitfield and on_have
+    Bitfield bitfield;
+
+    // input buffer acquired from the engine and the reader framing messages in it
+    uint8_t *input;
+    FrameReader reader;
+    // the block the next read goes to, if any
+    std::optional<InPlaceBlock> in_place_block;
+
+    // messages are serialized into output, which is swapped with sending when no write is in flight,
+    // so everything queued in between goes out in one write
+    OutputBuffer output;
+    OutputBuffer sending;
+    bool write_pending;
+
+    /**
+     * @brief runs a step of the session, failing the session if it throws
+     *
+     * @param step
+     */
+    void guard(const std::function<void()> &step);
+
+    /**
+     * @brief closes the session and reports the reason to the owner
+     *
+     * @param reason
+     */
+    void fail(const std::string &reason);
+
+    /**
+     * @brief checks the timeout of the current state after the delay instead of the check scheduled before,
+     * the timer doesn't keep the session alive
+     *
+     * @param delay
+     */
+    void schedule_timeout_check(std::chrono::steady_clock::duration delay);
+
+    /**
+     * @brief fails the session if the peer took too long for the current state, or checks again at the deadline
+     *
+     */
+    void check_timeout();
+
+    /**
+     * @brief gives the outstanding requests back to the scheduler, the peer won't answer them
+     *
+     */
+    void release_requests();
+
+    /**
+     * @brief hands the queued bytes to the I/O engine unless a write is already in flight, the rest of a short write goes first
+     *
+     */
+    void flush();
+
+    /**
+     * @brief asks the I/O engine to read into the free part of the input buffer
+     *
+     */
+    void start_read();
+
+    /**
+     * @brief parses the complete handshake and messages from the input buffer and drives the state machine
+     *
+     */
+    void process_input();
+
+    /**
+     * @brief receives the rest of a partly received block straight into its piece, unless the block
+     * wasn't requested, was received from another peer or endgame is on (where the first complete copy wins)
+     *
+     * @param received the block's header and the part of it in the input buffer
+     * @param block_length
+     * @return true if the next reads go to the block
+     * @return false if the block is read through the input buffer
+     */
+    bool start_in_place_block(const BlockView &received, uint32_t block_length);
+
+    /**
+     * @brief hands the block received in place to the scheduler and goes back to reading into the input buffer
+     *
+     */
+    void finish_in_place_block();
+
+    /**
+     * @brief gives a block left half received back to the scheduler once no read can write into it anymore
+     *
+     */
+    void abort_in_place_block();
+
+    /**
+     * @brief validates the peer's handshake
+     *
+     * @param handshake
+     */
+    void handle_handshake(std::string_view handshake);
+
+    /**
+     * @brief reacts to a message from the peer according to the current state
+     *
+     * @param message
+     */
+    void handle_message(const MessageView &message);
+
+public:
+    /**
+     * @brief creates the socket for the session, start() connects it
+     *
+     * @param engine
+     * @param metaInfo
+     * @param scheduler hands out the blocks to request
+     * @param shard the scheduler shard of the event loop
+     * @param peer_ip
+     * @param peer_port
+     * @param callbacks
+     * @param timeouts
+     */
+    PeerSession(IoEngine &engine, MetaInfo &metaInfo, BlockScheduler &scheduler, size_t shard, const std::string &peer_ip, const std::string &peer_port, SessionCallbacks callbacks, SessionTimeouts timeouts = SessionTimeouts());
+
+    PeerSession(const PeerSession &) = delete;
+    PeerSession &operator=(const PeerSession &) = delete;
+
+    /**
+     * @brief gives the input buffer back to the I/O engine, and a block left half received back to the scheduler
+     * (only now no read can write into it anymore)
+     *
+     */
+    ~PeerSession();
+
+    /**
+     * @brief connects to the peer, the session must be owned by a std::shared_ptr,
+     * it fails if the connect or the handshake takes too long or the peer goes silent
+     *
+     */
+    void start();
+
+    /**
+     * @brief returns the current state of the session
+     *
+     * @return SessionState
+     */
+    SessionState get_state();
+
+    /**
+     * @brief returns the peer address as ip:port
+     *
+     * @return std::string
+     */
+    std::string get_address();
+
+    /**
+     * @brief returns the pieces the peer has
+     *
+     * @return const Bitfield&
+     */
+    const Bitfield &get_bitfield();
+
+    /**
+     * @brief requests blocks until the request window is full, does nothing unless the peer unchoked us
+     *
+     */
+    void request_blocks();
+
+    /**
+     * @brief sends CANCEL if the block is still requested from the peer, e.g. because another peer delivered it
+     *
+     * @param index
+     * @param begin
+     */
+    void cancel_block(uint32_t index, uint32_t begin);
+
+    /**
+     * @brief returns the download rate since the previous measurement, or since the session started, in bytes per second
+     *
+     * @return double
+     */
+    double measure_download_rate();
+
+    /**
+     * @brief returns how long ago the session started
+     *
+     * @return std::chrono::steady_clock::duration
+     */
+    std::chrono::steady_clock::duration get_connected_time();
+
+    /**
+     * @brief closes the session like a failure, on_closed is called with the reason
+     *
+     * @param reason
+     */
+    void disconnect(const std::string &reason);
+
+    /**
+     * @brief releases the outstanding requests of the session, aborts its pending I/O and marks it closed
+     *
+     */
+    void close();
+};
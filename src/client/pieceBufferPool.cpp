@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "client/pieceBufferPool.hpp"
+
+PieceBuffer::PieceBuffer()
+{
+    this->pool = nullptr;
+    this->buffer = nullptr;
+    this->length = 0;
+}
+
+PieceBuffer::PieceBuffer(PieceBufferPool *pool, uint8_t *buffer, size_t length)
+{
+    this->pool = pool;
+    this->buffer = buffer;
+    this->length = length;
+}
+
+PieceBuffer::PieceBuffer(PieceBuffer &&other) noexcept
+{
+    this->pool = std::exchange(other.pool, nullptr);
+    this->buffer = std::exchange(other.buffer, nullptr);
+    this->length = std::exchange(other.length, 0);
+}
+
+PieceBuffer &PieceBuffer::operator=(PieceBuffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (this->buffer != nullptr)
+        {
+            this->pool->release(this->buffer);
+        }
+
+        this->pool = std::exchange(other.pool, nullptr);
+        this->buffer = std::exchange(other.buffer, nullptr);
+        this->length = std::exchange(other.length, 0);
+    }
+
+    return *this;
+}
+
+PieceBuffer::~PieceBuffer()
+{
+    if (this->buffer != nullptr)
+    {
+        this->pool->release(this->buffer);
+    }
+}
+
+void PieceBuffer::resize(size_t length)
+{
+    if (this->buffer == nullptr || length > this->pool->piece_length)
+    {
+        throw std::runtime_error("Piece buffer too small for " + std::to_string(length) + " bytes");
+    }
+
+    this->length = length;
+}
+
+uint8_t *PieceBuffer::data()
+{
+    return this->buffer;
+}
+
+const uint8_t *PieceBuffer::data() const
+{
+    return this->buffer;
+}
+
+size_t PieceBuffer::size() const
+{
+    return this->length;
+}
+
+bool PieceBuffer::empty() const
+{
+    return this->buffer == nullptr;
+}
+
+PieceBufferPool::PieceBufferPool(size_t piece_length, size_t memory_limit)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+
+    this->piece_length = piece_length;
+    this->buffer_size = std::max<size_t>((piece_length + page_size - 1) / page_size, 1) * page_size;
+    this->max_buffers = std::max<size_t>(memory_limit / this->buffer_size, 1);
+    this->allocated = 0;
+    this->exhausted = false;
+}
+
+PieceBufferPool::~PieceBufferPool()
+{
+    for (uint8_t *buffer : this->free_buffers)
+    {
+        std::free(buffer);
+    }
+}
+
+bool PieceBufferPool::acquire(PieceBuffer &buffer)
+{
+    uint8_t *taken;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->free_buffers.empty())
+        {
+            taken = this->free_buffers.back();
+            this->free_buffers.pop_back();
+        }
+        else if (this->allocated < this->max_buffers)
+        {
+            // page-aligned so the kernel can copy whole pages from it when the piece is written
+            taken = static_cast<uint8_t *>(std::aligned_alloc(sysconf(_SC_PAGESIZE), this->buffer_size));
+            if (taken == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            this->allocated++;
+            // handing a buffer back never allocates
+            this->free_buffers.reserve(this->allocated);
+        }
+        else
+        {
+            this->exhausted = true;
+            return false;
+        }
+    }
+
+    buffer = PieceBuffer(this, taken, this->piece_length);
+    return true;
+}
+
+void PieceBufferPool::release(uint8_t *buffer)
+{
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->free_buffers.push_back(buffer);
+        if (this->exhausted)
+        {
+            this->exhausted = false;
+            notify = this->on_available;
+        }
+    }
+
+    // called without the lock, so it may acquire the buffer again
+    if (notify)
+    {
+        notify();
+    }
+}
+
+void PieceBufferPool::set_on_available(std::function<void()> on_available)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->on_available = std::move(on_available);
+}
+
+size_t PieceBufferPool::get_buffers_in_use()
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->allocated - this->free_buffers.size();
+}
+
+size_t PieceBufferPool::get_max_buffers()
+{
+    return this->max_buffers;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+class PieceBufferPool;
+
+// The data of a piece being downloaded, verified and written, borrowed from a PieceBufferPool.
+// Only moved along the way, never copied, and handed back to its pool when destroyed.
+class PieceBuffer
+{
+private:
+    PieceBufferPool *pool;
+    uint8_t *buffer;
+    size_t length;
+
+public:
+    /**
+     * @brief creates an empty handle that holds no buffer
+     *
+     */
+    PieceBuffer();
+
+    /**
+     * @brief takes over a buffer of a pool, used by the pool
+     *
+     * @param pool
+     * @param buffer
+     * @param length
+     */
+    PieceBuffer(PieceBufferPool *pool, uint8_t *buffer, size_t length);
+
+    PieceBuffer(PieceBuffer &&other) noexcept;
+    PieceBuffer &operator=(PieceBuffer &&other) noexcept;
+
+    PieceBuffer(const PieceBuffer &) = delete;
+    PieceBuffer &operator=(const PieceBuffer &) = delete;
+
+    /**
+     * @brief hands the buffer back to its pool
+     *
+     */
+    ~PieceBuffer();
+
+    /**
+     * @brief sets the number of bytes used, e.g. for the shorter last piece
+     *
+     * @param length at most the piece length of the pool
+     */
+    void resize(size_t length);
+
+    /**
+     * @brief returns the piece data
+     *
+     * @return uint8_t*
+     */
+    uint8_t *data();
+
+    /**
+     * @brief returns the piece data
+     *
+     * @return const uint8_t*
+     */
+    const uint8_t *data() const;
+
+    /**
+     * @brief returns the number of bytes used
+     *
+     * @return size_t
+     */
+    size_t size() const;
+
+    /**
+     * @brief returns true if the handle holds no buffer
+     *
+     * @return true
+     * @return false
+     */
+    bool empty() const;
+};
+
+// Page-aligned buffers of a piece length, reused from piece to piece so a download allocates them only once.
+// The memory they take is capped: when every buffer allowed is in use no new piece is started,
+// and once one is handed back the owner is told (on_available) so it can start pieces again.
+// Buffers are allocated as they are needed and kept until the pool is destroyed, which must be after every buffer came back.
+class PieceBufferPool
+{
+private:
+    size_t piece_length;
+    // the piece length rounded up to whole pages
+    size_t buffer_size;
+    size_t max_buffers;
+    size_t allocated;
+    std::vector<uint8_t *> free_buffers;
+    // an acquire() failed since the last buffer was handed back
+    bool exhausted;
+    std::function<void()> on_available;
+    std::mutex mutex;
+
+    friend class PieceBuffer;
+
+    /**
+     * @brief takes a buffer back, called by PieceBuffer
+     *
+     * @param buffer
+     */
+    void release(uint8_t *buffer);
+
+public:
+    static constexpr size_t DEFAULT_MEMORY_LIMIT = 256 * 1024 * 1024;
+
+    /**
+     * @brief creates a pool of buffers of a piece length
+     *
+     * @param piece_length
+     * @param memory_limit bytes the buffers may take, at least one buffer is always allowed
+     */
+    PieceBufferPool(size_t piece_length, size_t memory_limit = DEFAULT_MEMORY_LIMIT);
+
+    PieceBufferPool(const PieceBufferPool &) = delete;
+    PieceBufferPool &operator=(const PieceBufferPool &) = delete;
+
+    /**
+     * @brief frees the buffers
+     *
+     */
+    ~PieceBufferPool();
+
+    /**
+     * @brief takes a buffer of the piece length, unless the memory limit is reached
+     *
+     * @param buffer receives the buffer
+     * @return true if a buffer was taken
+     * @return false if every buffer allowed is in use
+     */
+    bool acquire(PieceBuffer &buffer);
+
+    /**
+     * @brief sets the function called (on the thread handing it back) when a buffer comes back after an acquire() failed
+     *
+     * @param on_available
+     */
+    void set_on_available(std::function<void()> on_available);
+
+    /**
+     * @brief returns the number of buffers in use
+     *
+     * @return size_t
+     */
+    size_t get_buffers_in_use();
+
+    /**
+     * @brief returns the number of buffers the memory limit allows
+     *
+     * @return size_t
+     */
+    size_t get_max_buffers();
+};
@@ -0,0 +1,174 @@
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "client/piecePicker.hpp"
+
+PiecePicker::PiecePicker(size_t number_of_pieces)
+    : availability(number_of_pieces, 0), states(number_of_pieces, PieceState::WANTED), wanted_count(number_of_pieces),
+      order(number_of_pieces), positions(number_of_pieces),
+      bucket_starts{0, number_of_pieces}, random(std::random_device()())
+{
+    for (size_t i = 0; i < number_of_pieces; ++i)
+    {
+        this->order[i] = i;
+        this->positions[i] = i;
+    }
+}
+
+void PiecePicker::swap_positions(size_t a, size_t b)
+{
+    std::swap(this->order[a], this->order[b]);
+    this->positions[this->order[a]] = a;
+    this->positions[this->order[b]] = b;
+}
+
+void PiecePicker::increment(size_t piece_index)
+{
+    uint32_t count = this->availability[piece_index];
+    if (this->bucket_starts.size() < count + 3)
+    {
+        this->bucket_starts.resize(count + 3, this->order.size());
+    }
+
+    // the last piece of bucket count becomes the first piece of bucket count + 1
+    size_t last = this->bucket_starts[count + 1] - 1;
+    this->swap_positions(this->positions[piece_index], last);
+    this->bucket_starts[count + 1]--;
+    this->availability[piece_index]++;
+}
+
+void PiecePicker::decrement(size_t piece_index)
+{
+    uint32_t count = this->availability[piece_index];
+    if (count == 0)
+    {
+        return;
+    }
+
+    // the first piece of bucket count becomes the last piece of bucket count - 1
+    size_t first = this->bucket_starts[count];
+    this->swap_positions(this->positions[piece_index], first);
+    this->bucket_starts[count]++;
+    this->availability[piece_index]--;
+}
+
+void PiecePicker::add_peer(const Bitfield &bitfield)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (size_t i = 0; i < this->availability.size(); ++i)
+    {
+        if (bitfield.has(i))
+        {
+            this->increment(i);
+        }
+    }
+}
+
+void PiecePicker::remove_peer(const Bitfield &bitfield)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (size_t i = 0; i < this->availability.size(); ++i)
+    {
+        if (bitfield.has(i))
+        {
+            this->decrement(i);
+        }
+    }
+}
+
+void PiecePicker::add_have(size_t piece_index)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (piece_index >= this->availability.size())
+    {
+        throw std::runtime_error("Invalid piece index: " + std::to_string(piece_index));
+    }
+
+    this->increment(piece_index);
+}
+
+bool PiecePicker::pick(const Bitfield &bitfield, size_t &piece_index)
+{
+    if (this->wanted_count.load(std::memory_order_relaxed) == 0)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    // pieces nobody has can't be picked, start at the bucket of pieces only one peer has
+    for (size_t count = 1; count + 1 < this->bucket_starts.size(); ++count)
+    {
+        size_t begin = this->bucket_starts[count];
+        size_t end = this->bucket_starts[count + 1];
+        if (begin == end)
+        {
+            continue;
+        }
+
+        // scan the bucket from a random position, wrapping around
+        size_t offset = std::uniform_int_distribution<size_t>(0, end - begin - 1)(this->random);
+        for (size_t i = 0; i < end - begin; ++i)
+        {
+            size_t candidate = this->order[begin + (offset + i) % (end - begin)];
+            if (this->states[candidate] == PieceState::WANTED && bitfield.has(candidate))
+            {
+                this->states[candidate] = PieceState::ASSIGNED;
+                this->wanted_count--;
+                piece_index = candidate;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void PiecePicker::release(size_t piece_index)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (piece_index < this->states.size() && this->states[piece_index] == PieceState::ASSIGNED)
+    {
+        this->states[piece_index] = PieceState::WANTED;
+        this->wanted_count++;
+    }
+}
+
+bool PiecePicker::mark_done(size_t piece_index)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (piece_index >= this->states.size() || this->states[piece_index] == PieceState::DONE)
+    {
+        return false;
+    }
+
+    if (this->states[piece_index] == PieceState::WANTED)
+    {
+        this->wanted_count--;
+    }
+
+    this->states[piece_index] = PieceState::DONE;
+    return true;
+}
+
+bool PiecePicker::is_endgame()
+{
+    return this->wanted_count.load(std::memory_order_relaxed) == 0;
+}
+
+uint32_t PiecePicker::get_availability(size_t piece_index)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (piece_index >= this->availability.size())
+    {
+        throw std::runtime_error("Invalid piece index: " + std::to_string(piece_index));
+    }
+
+    return this->availability[piece_index];
+}
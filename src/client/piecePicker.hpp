@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "client/bitfield.hpp"
+
+// Decides which piece a peer downloads next: the rarest piece among the connected peers that this peer has,
+// ties broken at random so peers don't all converge on the same piece.
+// Pieces are kept sorted by availability in one array, each availability value owning a contiguous bucket of it,
+// so a HAVE moves a piece to the neighbouring bucket with a single swap and a pick scans the rarest pieces first.
+// Shared by the event loops, every method locks except is_endgame(), which sessions ask on every block.
+class PiecePicker
+{
+private:
+    enum class PieceState : uint8_t
+    {
+        WANTED,   // nobody is downloading it
+        ASSIGNED, // its blocks are being downloaded
+        DONE      // verified and written
+    };
+
+    std::vector<uint32_t> availability;
+    std::vector<PieceState> states;
+    // changed under the lock, read without it
+    std::atomic<size_t> wanted_count;
+    // piece indices sorted by availability, and where each piece sits in it
+    std::vector<size_t> order;
+    std::vector<size_t> positions;
+    // bucket_starts[n] is the first position in order with availability >= n
+    std::vector<size_t> bucket_starts;
+    std::minstd_rand random;
+    std::mutex mutex;
+
+    /**
+     * @brief moves a piece one bucket up
+     *
+     * @param piece_index
+     */
+    void increment(size_t piece_index);
+
+    /**
+     * @brief moves a piece one bucket down
+     *
+     * @param piece_index
+     */
+    void decrement(size_t piece_index);
+
+    /**
+     * @brief swaps the pieces at two positions of order
+     *
+     * @param a
+     * @param b
+     */
+    void swap_positions(size_t a, size_t b);
+
+public:
+    /**
+     * @brief creates a picker where every piece is wanted and nobody has any
+     *
+     * @param number_of_pieces
+     */
+    PiecePicker(size_t number_of_pieces);
+
+    PiecePicker(const PiecePicker &) = delete;
+    PiecePicker &operator=(const PiecePicker &) = delete;
+
+    /**
+     * @brief counts the pieces of a newly connected peer
+     *
+     * @param bitfield
+     */
+    void add_peer(const Bitfield &bitfield);
+
+    /**
+     * @brief stops counting the pieces of a disconnected peer
+     *
+     * @param bitfield
+     */
+    void remove_peer(const Bitfield &bitfield);
+
+    /**
+     * @brief counts a piece a peer announced with HAVE
+     *
+     * @param piece_index
+     */
+    void add_have(size_t piece_index);
+
+    /**
+     * @brief assigns the rarest wanted piece the peer has
+     *
+     * @param bitfield the pieces of the peer
+     * @param piece_index set to the assigned piece
+     * @return true if a piece was assigned
+     * @return false if the peer has none of the wanted pieces
+     */
+    bool pick(const Bitfield &bitfield, size_t &piece_index);
+
+    /**
+     * @brief makes an assigned piece wanted again, e.g. when nobody is downloading it anymore or it failed verification
+     *
+     * @param piece_index
+     */
+    void release(size_t piece_index);
+
+    /**
+     * @brief marks a piece as downloaded, it is never picked again
+     *
+     * @param piece_index
+     * @return true
+     * @return false if the piece was already done
+     */
+    bool mark_done(size_t piece_index);
+
+    /**
+     * @brief returns true once no piece is waiting to be started, the pieces left are all being downloaded
+     *
+     * @return true
+     * @return false
+     */
+    bool is_endgame();
+
+    /**
+     * @brief returns the number of connected peers that have the piece
+     *
+     * @param piece_index
+     * @return uint32_t
+     */
+    uint32_t get_availability(size_t piece_index);
+};
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "client/piecePipeline.hpp"
+
+PiecePipeline::PiecePipeline(RequestWindow request_window) : request_window(request_window)
+{
+    this->has_current_piece = false;
+    this->current_piece = 0;
+    this->current_piece_length = 0;
+    this->block_offset = 0;
+    this->incremental_hashing = false;
+}
+
+void PiecePipeline::set_incremental_hashing(bool enabled)
+{
+    this->incremental_hashing = enabled;
+}
+
+RequestWindow &PiecePipeline::get_request_window()
+{
+    return this->request_window;
+}
+
+void PiecePipeline::fill(MetaInfo &metaInfo, const std::function<bool(size_t &)> &next_piece, const std::function<void(uint32_t, uint32_t, uint32_t)> &send_request)
+{
+    const uint32_t BLOCK_SIZE = RequestWindow::BLOCK_SIZE;
+
+    while (!this->request_window.is_full())
+    {
+        if (!this->has_current_piece || this->block_offset >= this->current_piece_length)
+        {
+            this->has_current_piece = false;
+
+            size_t piece_index;
+            if (!next_piece(piece_index))
+            {
+                return;
+            }
+
+            this->has_current_piece = true;
+            this->current_piece = piece_index;
+            this->current_piece_length = metaInfo.get_piece_length(piece_index);
+            this->block_offset = 0;
+            this->in_progress[piece_index] = PieceProgress{std::vector<uint8_t>(this->current_piece_length), 0, Sha1Engine(), 0};
+        }
+
+        uint32_t block_length = std::min(BLOCK_SIZE, this->current_piece_length - this->block_offset);
+
+        send_request(this->current_piece, this->block_offset, block_length);
+        this->request_window.add(this->current_piece, this->block_offset, block_length);
+
+        this->block_offset += block_length;
+    }
+}
+
+void PiecePipeline::on_block(const BlockView &block, const std::function<void(size_t, std::vector<uint8_t>, std::optional<Sha1Digest>)> &on_piece)
+{
+    uint8_t *destination = this->get_block_destination(block.index, block.begin, block.size);
+    if (destination == nullptr)
+    {
+        // a block we didn't ask for (or a duplicate), ignore it
+        return;
+    }
+
+    std::copy(block.data, block.data + block.size, destination);
+    this->complete_block(block.index, block.begin, block.size, on_piece);
+}
+
+uint8_t *PiecePipeline::get_block_destination(uint32_t index, uint32_t begin, uint32_t length)
+{
+    const std::deque<PendingRequest> &outstanding = this->request_window.get_outstanding();
+    auto request = std::find_if(outstanding.begin(), outstanding.end(), [&](const PendingRequest &pending)
+                                { return pending.index == index && pending.begin == begin; });
+
+    auto piece = this->in_progress.find(index);
+    if (piece == this->in_progress.end() || request == outstanding.end())
+    {
+        return nullptr;
+    }
+
+    // a block shorter (or longer) than requested would leave a gap in the piece that is never filled
+    if (request->length != length)
+    {
+        throw std::runtime_error("Received block of wrong length, piece: " + std::to_string(index) + " begin: " + std::to_string(begin) + " length: " + std::to_string(length) + " requested: " + std::to_string(request->length));
+    }
+
+    if (begin + length > piece->second.data.size())
+    {
+        throw std::runtime_error("Received block out of piece bounds, piece: " + std::to_string(index) + " begin: " + std::to_string(begin) + " length: " + std::to_string(length));
+    }
+
+    return piece->second.data.data() + begin;
+}
+
+void PiecePipeline::complete_block(uint32_t index, uint32_t begin, uint32_t length, const std::function<void(size_t, std::vector<uint8_t>, std::optional<Sha1Digest>)> &on_piece)
+{
+    auto piece = this->in_progress.find(index);
+    if (piece == this->in_progress.end() || !this->request_window.complete(index, begin, length))
+    {
+        return;
+    }
+
+    piece->second.bytes_received += length;
+
+    if (this->incremental_hashing && begin == piece->second.hashed_bytes)
+    {
+        // the block extends the hashed prefix, hash it while it is still in cache
+        piece->second.hasher.update(piece->second.data.data() + begin, length);
+        piece->second.hashed_bytes += length;
+    }
+
+    if (piece->second.bytes_received == piece->second.data.size())
+    {
+        std::optional<Sha1Digest> digest;
+        if (this->incremental_hashing && piece->second.hashed_bytes == piece->second.data.size())
+        {
+            digest = piece->second.hasher.final();
+        }
+
+        std::vector<uint8_t> piece_data = std::move(piece->second.data);
+        this->in_progress.erase(piece);
+        on_piece(index, std::move(piece_data), digest);
+    }
+}
+
+bool PiecePipeline::is_idle()
+{
+    return this->request_window.is_empty();
+}
+
+std::vector<size_t> PiecePipeline::get_pieces_in_progress()
+{
+    std::vector<size_t> result;
+    for (const auto &[piece_index, progress] : this->in_progress)
+    {
+        result.push_back(piece_index);
+    }
+
+    return result;
+}
+
+std::vector<size_t> PiecePipeline::reset()
+{
+    std::vector<size_t> dropped = this->get_pieces_in_progress();
+
+    this->request_window.clear();
+    this->in_progress.clear();
+    this->has_current_piece = false;
+
+    return dropped;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "metainfo/metainfo.hpp"
+#include "messageHandler/message.hpp"
+#include "client/requestWindow.hpp"
+#include "metainfo/sha1Engine.hpp"
+
+class PiecePipeline
+{
+private:
+    struct PieceProgress
+    {
+        std::vector<uint8_t> data;
+        size_t bytes_received;
+        // running hash over the blocks received in order, data[0, hashed_bytes)
+        Sha1Engine hasher;
+        size_t hashed_bytes;
+    };
+
+    RequestWindow request_window;
+    std::map<size_t, PieceProgress> in_progress;
+    bool incremental_hashing;
+
+    // the piece whose blocks are currently being requested
+    bool has_current_piece;
+    size_t current_piece;
+    uint32_t current_piece_length;
+    uint32_t block_offset;
+
+public:
+    /**
+     * @brief creates an empty pipeline that sends its requests over the given window
+     *
+     * @param request_window
+     */
+    PiecePipeline(RequestWindow request_window = RequestWindow());
+
+    /**
+     * @brief returns the request window, can be used to configure its limits
+     *
+     * @return RequestWindow&
+     */
+    RequestWindow &get_request_window();
+
+    /**
+     * @brief hashes blocks as they arrive in order, so a piece whose blocks all arrived in order comes with its digest
+     *
+     * @param enabled
+     */
+    void set_incremental_hashing(bool enabled);
+
+    /**
+     * @brief issues block requests until the window is full, moving on to the next piece as soon as all blocks of the current one are requested
+     *
+     * @param metaInfo
+     * @param next_piece called whenever the window has room for a new piece, returns false when there are no more pieces to fetch
+     * @param send_request called with (index, begin, length) of every block to request
+     */
+    void fill(MetaInfo &metaInfo, const std::function<bool(size_t &)> &next_piece, const std::function<void(uint32_t, uint32_t, uint32_t)> &send_request);
+
+    /**
+     * @brief copies a received block into its piece, calls on_piece with the piece data once all of its blocks arrived,
+     * along with its digest if it was hashed incrementally (empty when blocks arrived out of order)
+     *
+     * @param block
+     * @param on_piece
+     */
+    void on_block(const BlockView &block, const std::function<void(size_t, std::vector<uint8_t>, std::optional<Sha1Digest>)> &on_piece);
+
+    /**
+     * @brief returns where a requested block goes in its piece, so it can be received in place,
+     * complete_block() must be called once it is
+     *
+     * @param index
+     * @param begin
+     * @param length
+     * @return uint8_t* nullptr if the block wasn't requested (or was received already),
+     * throws if its length differs from the one requested
+     */
+    uint8_t *get_block_destination(uint32_t index, uint32_t begin, uint32_t length);
+
+    /**
+     * @brief accounts for a block received in place at get_block_destination(), like on_block() without the copy
+     *
+     * @param index
+     * @param begin
+     * @param length
+     * @param on_piece
+     */
+    void complete_block(uint32_t index, uint32_t begin, uint32_t length, const std::function<void(size_t, std::vector<uint8_t>, std::optional<Sha1Digest>)> &on_piece);
+
+    /**
+     * @brief returns true if there are no outstanding requests
+     *
+     * @return true
+     * @return false
+     */
+    bool is_idle();
+
+    /**
+     * @brief returns the indices of the pieces that were started but not completed
+     *
+     * @return std::vector<size_t>
+     */
+    std::vector<size_t> get_pieces_in_progress();
+
+    /**
+     * @brief drops all outstanding requests and partial pieces and returns the indices of the dropped pieces
+     *
+     * @return std::vector<size_t>
+     */
+    std::vector<size_t> reset();
+};
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+#include "client/requestWindow.hpp"
+
+RequestWindow::RequestWindow(size_t min_size, size_t max_size)
+{
+    this->min_size = std::max<size_t>(min_size, 1);
+    this->max_size = std::max(max_size, this->min_size);
+    this->target_size = this->min_size;
+    this->min_rtt = 0;
+    this->rate = 0;
+    this->sample_bytes = 0;
+    this->sample_start = clock::now();
+}
+
+bool RequestWindow::is_full()
+{
+    return this->outstanding.size() >= this->target_size;
+}
+
+bool RequestWindow::is_empty()
+{
+    return this->outstanding.empty();
+}
+
+size_t RequestWindow::get_size()
+{
+    return this->target_size;
+}
+
+size_t RequestWindow::get_outstanding_count()
+{
+    return this->outstanding.size();
+}
+
+void RequestWindow::add(uint32_t index, uint32_t begin, uint32_t length)
+{
+    if (this->outstanding.empty())
+    {
+        // the pipe was idle, don't count the idle time against the measured rate
+        this->sample_bytes = 0;
+        this->sample_start = clock::now();
+    }
+
+    this->outstanding.push_back(PendingRequest{index, begin, length, clock::now()});
+}
+
+bool RequestWindow::complete(uint32_t index, uint32_t begin, uint32_t length)
+{
+    // peers usually answer in order, so the match is almost always at the front
+    auto it = std::find_if(this->outstanding.begin(), this->outstanding.end(), [&](const PendingRequest &request)
+                           { return request.index == index && request.begin == begin; });
+
+    if (it == this->outstanding.end())
+    {
+        return false;
+    }
+
+    // the request stays outstanding, so whoever drops the peer over it still sees it and can hand the block to another peer
+    if (length != it->length)
+    {
+        throw std::runtime_error("Received block of wrong length, piece: " + std::to_string(index) + " begin: " + std::to_string(begin) + " length: " + std::to_string(length) + " requested: " + std::to_string(it->length));
+    }
+
+    auto now = clock::now();
+    double rtt = std::chrono::duration<double>(now - it->sent_at).count();
+    if (this->min_rtt == 0 || rtt < this->min_rtt)
+    {
+        this->min_rtt = rtt;
+    }
+
+    this->outstanding.erase(it);
+
+    // update the download rate every half a second
+    this->sample_bytes += length;
+    double elapsed = std::chrono::duration<double>(now - this->sample_start).count();
+    if (elapsed >= 0.5)
+    {
+        double sample_rate = this->sample_bytes / elapsed;
+        this->rate = (this->rate == 0) ? sample_rate : 0.7 * this->rate + 0.3 * sample_rate;
+        this->sample_bytes = 0;
+        this->sample_start = now;
+        this->resize();
+    }
+
+    return true;
+}
+
+bool RequestWindow::contains(uint32_t index, uint32_t begin)
+{
+    return std::any_of(this->outstanding.begin(), this->outstanding.end(), [&](const PendingRequest &request)
+                       { return request.index == index && request.begin == begin; });
+}
+
+std::optional<PendingRequest> RequestWindow::remove(uint32_t index, uint32_t begin)
+{
+    auto it = std::find_if(this->outstanding.begin(), this->outstanding.end(), [&](const PendingRequest &request)
+                           { return request.index == index && request.begin == begin; });
+
+    if (it == this->outstanding.end())
+    {
+        return std::nullopt;
+    }
+
+    PendingRequest removed = *it;
+    this->outstanding.erase(it);
+    return removed;
+}
+
+const std::deque<PendingRequest> &RequestWindow::get_outstanding()
+{
+    return this->outstanding;
+}
+
+void RequestWindow::clear()
+{
+    this->outstanding.clear();
+}
+
+void RequestWindow::resize()
+{
+    if (this->rate == 0 || this->min_rtt == 0)
+    {
+        return;
+    }
+
+    // keep twice the bandwidth-delay product in flight, while the window limits the rate
+    // the measured product grows with it, so the window keeps growing until the link is saturated
+    double bdp_blocks = this->rate * this->min_rtt / BLOCK_SIZE;
+    size_t desired = static_cast<size_t>(std::ceil(2 * bdp_blocks));
+
+    this->target_size = std::clamp(desired, this->min_size, this->max_size);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <deque>
+#include <optional>
+
+struct PendingRequest
+{
+    uint32_t index;
+    uint32_t begin;
+    uint32_t length;
+    std::chrono::steady_clock::time_point sent_at;
+};
+
+class RequestWindow
+{
+private:
+    using clock = std::chrono::steady_clock;
+
+    size_t min_size;
+    size_t max_size;
+    size_t target_size;
+    std::deque<PendingRequest> outstanding;
+
+    // bandwidth-delay product estimation
+    double min_rtt;  // lowest observed request -> block latency in seconds
+    double rate;     // smoothed download rate in bytes per second
+    size_t sample_bytes;
+    clock::time_point sample_start;
+
+    /**
+     * @brief recomputes the target window size from the measured rate and round trip time
+     *
+     */
+    void resize();
+
+public:
+    static constexpr uint32_t BLOCK_SIZE = 16 * 1024;
+    static constexpr size_t DEFAULT_MIN_SIZE = 5;
+    static constexpr size_t DEFAULT_MAX_SIZE = 250;
+
+    /**
+     * @brief creates a request window that keeps between min_size and max_size requests in flight
+     *
+     * @param min_size
+     * @param max_size
+     */
+    RequestWindow(size_t min_size = DEFAULT_MIN_SIZE, size_t max_size = DEFAULT_MAX_SIZE);
+
+    /**
+     * @brief returns true if no more requests should be sent until a block arrives
+     *
+     * @return true
+     * @return false
+     */
+    bool is_full();
+
+    /**
+     * @brief returns true if there are no outstanding requests
+     *
+     * @return true
+     * @return false
+     */
+    bool is_empty();
+
+    /**
+     * @brief returns the current number of requests the window allows in flight
+     *
+     * @return size_t
+     */
+    size_t get_size();
+
+    /**
+     * @brief returns the number of requests sent but not answered yet
+     *
+     * @return size_t
+     */
+    size_t get_outstanding_count();
+
+    /**
+     * @brief records a request that has been sent to the peer
+     *
+     * @param index
+     * @param begin
+     * @param length
+     */
+    void add(uint32_t index, uint32_t begin, uint32_t length);
+
+    /**
+     * @brief matches a received block against the outstanding requests by (index, begin) and removes it from the window,
+     * throws if its length isn't the requested one, the request is left outstanding then
+     *
+     * @param index
+     * @param begin
+     * @param length length of the received block
+     * @return true if the block was requested
+     * @return false if the block was not requested (or already received)
+     */
+    bool complete(uint32_t index, uint32_t begin, uint32_t length);
+
+    /**
+     * @brief returns true if the block was requested and not received yet
+     *
+     * @param index
+     * @param begin
+     * @return true
+     * @return false
+     */
+    bool contains(uint32_t index, uint32_t begin);
+
+    /**
+     * @brief drops an outstanding request without counting it as answered and returns it, e.g. to cancel it
+     *
+     * @param index
+     * @param begin
+     * @return std::optional<PendingRequest> empty if the block wasn't outstanding
+     */
+    std::optional<PendingRequest> remove(uint32_t index, uint32_t begin);
+
+    /**
+     * @brief returns the requests sent but not answered yet, oldest first
+     *
+     * @return const std::deque<PendingRequest>&
+     */
+    const std::deque<PendingRequest> &get_outstanding();
+
+    /**
+     * @brief drops all outstanding requests, e.g. after the peer chokes us
+     *
+     */
+    void clear();
+};
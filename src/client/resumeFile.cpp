@@ -0,0 +1,253 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "client/resumeFile.hpp"
+#include "client/bitfield.hpp"
+#include "bencode/encode.hpp"
+#include "bencode/streamParser.hpp"
+#include "metainfo/metainfo.hpp"
+
+namespace
+{
+    // picks the info hash, the completed pieces and the state of each file out of a resume file
+    class ResumeHandler : public BencodeHandler
+    {
+    private:
+        struct RecordedFile
+        {
+            std::optional<int64_t> size;
+            std::optional<int64_t> mtime;
+        };
+
+        size_t depth;
+        // key of the root dict (depth 1), and of the file dict (depth 3) being read
+        std::string root_key;
+        std::string file_key;
+        std::vector<RecordedFile> recorded_files;
+
+        bool in_files()
+        {
+            return this->root_key == "files" && this->files;
+        }
+
+    public:
+        std::optional<std::string> info_hash;
+        std::optional<std::string> pieces;
+        std::optional<std::vector<FileState>> files;
+
+        ResumeHandler() : depth(0) {}
+
+        void begin_dict() override
+        {
+            this->depth++;
+            if (this->depth == 3 && this->in_files())
+            {
+                this->recorded_files.emplace_back();
+                this->file_key.clear();
+            }
+        }
+
+        void begin_list() override
+        {
+            this->depth++;
+            if (this->depth == 2 && this->root_key == "files")
+            {
+                this->files.emplace();
+            }
+        }
+
+        void end() override
+        {
+            if (this->depth == 3 && this->in_files())
+            {
+                const RecordedFile &file = this->recorded_files.back();
+                if (!file.size || !file.mtime || *file.size < 0)
+                {
+                    throw std::runtime_error("Invalid file state in the resume file");
+                }
+                this->files->push_back(FileState{static_cast<uint64_t>(*file.size), *file.mtime});
+            }
+            this->depth--;
+        }
+
+        void key(std::string_view key) override
+        {
+            if (this->depth == 1)
+            {
+                this->root_key = key;
+            }
+            else if (this->depth == 3)
+            {
+                this->file_key = key;
+            }
+        }
+
+        void integer(int64_t value) override
+        {
+            if (this->depth == 3 && this->in_files())
+            {
+                if (this->file_key == "size")
+                {
+                    this->recorded_files.back().size = value;
+                }
+                else if (this->file_key == "mtime")
+                {
+                    this->recorded_files.back().mtime = value;
+                }
+            }
+        }
+
+        void string(std::string_view fragment, bool) override
+        {
+            std::optional<std::string> *target = nullptr;
+            if (this->depth == 1 && this->root_key == "info hash")
+            {
+                target = &this->info_hash;
+            }
+            else if (this->depth == 1 && this->root_key == "pieces")
+            {
+                target = &this->pieces;
+            }
+
+            if (target != nullptr)
+            {
+                if (!*target)
+                {
+                    target->emplace();
+                }
+                (*target)->append(fragment);
+            }
+        }
+    };
+}
+
+ResumeFile::ResumeFile(const std::string &output_file)
+{
+    this->path = output_file + ".resume";
+}
+
+std::vector<FileState> ResumeFile::stat_files(const std::vector<std::string> &paths)
+{
+    std::vector<FileState> states;
+    for (const std::string &path : paths)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) < 0)
+        {
+            states.push_back(FileState{0, -1});
+            continue;
+        }
+
+        states.push_back(FileState{static_cast<uint64_t>(info.st_size), static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec});
+    }
+
+    return states;
+}
+
+bool ResumeFile::load(MetaInfo &metaInfo, Bitfield &completed, std::vector<FileState> &files)
+{
+    std::ifstream file(this->path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    try
+    {
+        ResumeHandler handler;
+        StreamParser parser(handler);
+
+        char chunk[64 * 1024];
+        while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0)
+        {
+            parser.feed(std::string_view(chunk, file.gcount()));
+        }
+        parser.finish();
+
+        if (!handler.info_hash || !handler.pieces || !handler.files || *handler.info_hash != metaInfo.get_info_hash())
+        {
+            return false;
+        }
+
+        completed = Bitfield::from_payload(reinterpret_cast<const uint8_t *>(handler.pieces->data()), handler.pieces->size(), metaInfo.get_number_of_pieces());
+        files = std::move(*handler.files);
+    }
+    catch (const std::exception &)
+    {
+        // a damaged resume file only costs the progress it recorded
+        return false;
+    }
+
+    return files.size() == metaInfo.get_files().size();
+}
+
+void ResumeFile::save(MetaInfo &metaInfo, const Bitfield &completed, const std::vector<FileState> &files)
+{
+    const std::vector<uint8_t> &bytes = completed.get_bytes();
+
+    json resume = {
+        {"info hash", metaInfo.get_info_hash()},
+        {"pieces", std::string(bytes.begin(), bytes.end())},
+        {"files", json::array()}};
+    for (const FileState &state : files)
+    {
+        resume["files"].push_back({{"size", state.size}, {"mtime", state.mtime}});
+    }
+
+    Encode encode;
+    std::string encoded_value = encode.encode_bencoded_value(resume);
+
+    // written next to the old one and renamed over it, so the resume file is always complete
+    std::string temporary_path = this->path + ".tmp";
+    int fd = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open " + temporary_path + ": " + std::strerror(errno));
+    }
+
+    size_t written = 0;
+    while (written < encoded_value.size())
+    {
+        ssize_t result = ::write(fd, encoded_value.data() + written, encoded_value.size() - written);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to write " + temporary_path + ": " + std::strerror(error));
+        }
+        written += result;
+    }
+
+    if (fsync(fd) < 0)
+    {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Failed to sync " + temporary_path + ": " + std::strerror(error));
+    }
+    ::close(fd);
+
+    if (std::rename(temporary_path.c_str(), this->path.c_str()) < 0)
+    {
+        throw std::runtime_error("Failed to replace " + this->path + ": " + std::strerror(errno));
+    }
+}
+
+std::string ResumeFile::get_path()
+{
+    return this->path;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "metainfo/metainfo.hpp"
+#include "client/bitfield.hpp"
+
+// size and modification time of an output file, as recorded in a resume file
+struct FileState
+{
+    uint64_t size;
+    // nanoseconds since the epoch, -1 if the file doesn't exist
+    int64_t mtime;
+
+    bool operator==(const FileState &other) const = default;
+};
+
+// The progress of a download kept next to its output (<output>.resume), so an interrupted download continues
+// where it stopped. It holds the info hash, the pieces written and synced to the disk, and the size and mtime
+// of every output file at the time. A piece whose files still have the recorded size and mtime is trusted
+// without hashing it again; the pieces of files changed since are verified before they are counted.
+// The file is bencoded and replaced atomically, a crash while saving leaves the previous one.
+class ResumeFile
+{
+private:
+    std::string path;
+
+public:
+    /**
+     * @brief creates the resume file of an output path, nothing is read or written yet
+     *
+     * @param output_file the output file, or the output directory for a multi-file torrent
+     */
+    ResumeFile(const std::string &output_file);
+
+    /**
+     * @brief returns the size and mtime of each file
+     *
+     * @param paths
+     * @return std::vector<FileState>
+     */
+    static std::vector<FileState> stat_files(const std::vector<std::string> &paths);
+
+    /**
+     * @brief reads the progress recorded for the torrent
+     *
+     * @param metaInfo
+     * @param completed receives the pieces recorded as written
+     * @param files receives the recorded state of the output files
+     * @return true if the resume file exists and belongs to the torrent
+     * @return false if there is none, or it is for another torrent or unreadable (it is ignored then)
+     */
+    bool load(MetaInfo &metaInfo, Bitfield &completed, std::vector<FileState> &files);
+
+    /**
+     * @brief records the progress of the download, the completed pieces must be synced to the disk already
+     *
+     * @param metaInfo
+     * @param completed
+     * @param files the state of the output files after the pieces were synced
+     */
+    void save(MetaInfo &metaInfo, const Bitfield &completed, const std::vector<FileState> &files);
+
+    /**
+     * @brief returns the path of the resume file
+     *
+     * @return std::string
+     */
+    std::string get_path();
+};
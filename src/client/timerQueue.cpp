@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include "client/timerQueue.hpp"
+
+namespace
+{
+    struct Later
+    {
+        template <typename Timer>
+        bool operator()(const Timer &a, const Timer &b) const
+        {
+            return a.deadline != b.deadline ? a.deadline > b.deadline : a.sequence > b.sequence;
+        }
+    };
+}
+
+TimerQueue::TimerQueue()
+{
+    this->next_sequence = 0;
+}
+
+void TimerQueue::add(clock::duration delay, std::function<void()> task)
+{
+    this->timers.push_back(Timer{clock::now() + delay, this->next_sequence++, std::move(task)});
+    std::push_heap(this->timers.begin(), this->timers.end(), Later());
+}
+
+bool TimerQueue::empty()
+{
+    return this->timers.empty();
+}
+
+std::optional<TimerQueue::clock::time_point> TimerQueue::next_deadline()
+{
+    if (this->timers.empty())
+    {
+        return std::nullopt;
+    }
+
+    return this->timers.front().deadline;
+}
+
+int TimerQueue::get_timeout_ms()
+{
+    if (this->timers.empty())
+    {
+        return -1;
+    }
+
+    auto remaining = this->timers.front().deadline - clock::now();
+    if (remaining <= clock::duration::zero())
+    {
+        return 0;
+    }
+
+    // round up, waking up early would only spin until the deadline
+    auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+    return static_cast<int>(std::min<decltype(milliseconds)>(milliseconds, INT_MAX));
+}
+
+void TimerQueue::run_expired()
+{
+    auto now = clock::now();
+    while (!this->timers.empty() && this->timers.front().deadline <= now)
+    {
+        std::pop_heap(this->timers.begin(), this->timers.end(), Later());
+        std::function<void()> task = std::move(this->timers.back().task);
+        this->timers.pop_back();
+
+        task();
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+// One-shot timers of an I/O engine, kept in a min-heap on their deadline.
+// Only touched from the engine thread.
+class TimerQueue
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    struct Timer
+    {
+        clock::time_point deadline;
+        uint64_t sequence; // keeps timers with the same deadline in the order they were added
+        std::function<void()> task;
+    };
+
+    std::vector<Timer> timers;
+    uint64_t next_sequence;
+
+public:
+    TimerQueue();
+
+    /**
+     * @brief schedules a task to run once the delay has passed
+     *
+     * @param delay
+     * @param task
+     */
+    void add(clock::duration delay, std::function<void()> task);
+
+    /**
+     * @brief returns true if no timer is pending
+     *
+     * @return true
+     * @return false
+     */
+    bool empty();
+
+    /**
+     * @brief returns the deadline of the earliest timer, empty if there is none
+     *
+     * @return std::optional<clock::time_point>
+     */
+    std::optional<clock::time_point> next_deadline();
+
+    /**
+     * @brief returns how long a poll may wait for the earliest timer in milliseconds (rounded up), -1 if there is none
+     *
+     * @return int
+     */
+    int get_timeout_ms();
+
+    /**
+     * @brief runs the tasks of the timers whose deadline has passed, tasks may add new timers
+     *
+     */
+    void run_expired();
+};
@@ -0,0 +1,477 @@
+#ifdef BITTORRENT_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "client/uringEngine.hpp"
+
+static int io_uring_setup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, const void *arg, unsigned nr_args)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+static unsigned load_acquire(unsigned *pointer)
+{
+    return std::atomic_ref<unsigned>(*pointer).load(std::memory_order_acquire);
+}
+
+static void store_release(unsigned *pointer, unsigned value)
+{
+    std::atomic_ref<unsigned>(*pointer).store(value, std::memory_order_release);
+}
+
+UringEngine::UringEngine()
+{
+    io_uring_params params{};
+    this->ring_fd = io_uring_setup(QUEUE_DEPTH, &params);
+    if (this->ring_fd < 0)
+    {
+        throw std::runtime_error("io_uring_setup failed: " + std::string(std::strerror(errno)));
+    }
+
+    // map the rings, newer kernels share one mapping for both
+    this->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    this->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+    {
+        this->sq_ring_size = this->cq_ring_size = std::max(this->sq_ring_size, this->cq_ring_size);
+    }
+
+    this->sq_ring = mmap(nullptr, this->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQ_RING);
+    if (this->sq_ring == MAP_FAILED)
+    {
+        close(this->ring_fd);
+        throw std::runtime_error("mmap of the submission ring failed");
+    }
+
+    this->cq_ring = single_mmap ? this->sq_ring : mmap(nullptr, this->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_CQ_RING);
+    if (this->cq_ring == MAP_FAILED)
+    {
+        munmap(this->sq_ring, this->sq_ring_size);
+        close(this->ring_fd);
+        throw std::runtime_error("mmap of the completion ring failed");
+    }
+
+    this->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        if (!single_mmap)
+        {
+            munmap(this->cq_ring, this->cq_ring_size);
+        }
+        munmap(this->sq_ring, this->sq_ring_size);
+        close(this->ring_fd);
+        throw std::runtime_error("mmap of the submission entries failed");
+    }
+    this->sqes = static_cast<io_uring_sqe *>(sqes);
+
+    uint8_t *sq = static_cast<uint8_t *>(this->sq_ring);
+    this->sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    this->sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    this->sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    this->sq_entries = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_entries);
+    this->sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    this->to_submit = 0;
+
+    uint8_t *cq = static_cast<uint8_t *>(this->cq_ring);
+    this->cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    this->cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    this->cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    this->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    this->in_flight = 0;
+
+    // register the read buffers once so the kernel doesn't have to map them on every read
+    size_t arena_size = BUFFER_SLOT_SIZE * BUFFER_SLOTS;
+    void *arena = mmap(nullptr, arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    this->buffer_arena = (arena == MAP_FAILED) ? nullptr : static_cast<uint8_t *>(arena);
+    this->buffers_registered = false;
+    if (this->buffer_arena != nullptr)
+    {
+        iovec arena_iovec{this->buffer_arena, arena_size};
+        this->buffers_registered = io_uring_register(this->ring_fd, IORING_REGISTER_BUFFERS, &arena_iovec, 1) == 0;
+        for (size_t i = BUFFER_SLOTS; i > 0; --i)
+        {
+            this->free_buffers.push_back(this->buffer_arena + (i - 1) * BUFFER_SLOT_SIZE);
+        }
+    }
+
+    this->wakeup_fd = eventfd(0, EFD_CLOEXEC);
+    this->wakeup_value = 0;
+    this->timeout_armed = false;
+    this->stopped = false;
+    this->arm_wakeup();
+
+    // older kernels reject the cancel flags with -EINVAL, a newer one finds nothing to cancel on the ring itself
+    this->cancel_by_fd = false;
+    io_uring_sqe *sqe = this->get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = this->ring_fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = PROBE_USER_DATA;
+    this->enter(1);
+    this->reap_completions();
+}
+
+UringEngine::~UringEngine()
+{
+    // closing the ring cancels whatever is still in flight, only then the callbacks can go
+    munmap(this->sqes, this->sqes_size);
+    if (this->cq_ring != this->sq_ring)
+    {
+        munmap(this->cq_ring, this->cq_ring_size);
+    }
+    munmap(this->sq_ring, this->sq_ring_size);
+    close(this->ring_fd);
+    close(this->wakeup_fd);
+
+    this->operations.clear();
+
+    if (this->buffer_arena != nullptr)
+    {
+        munmap(this->buffer_arena, BUFFER_SLOT_SIZE * BUFFER_SLOTS);
+    }
+}
+
+bool UringEngine::supports_cancel_by_fd()
+{
+    return this->cancel_by_fd;
+}
+
+io_uring_sqe *UringEngine::get_sqe()
+{
+    unsigned tail = *this->sq_tail;
+    if (tail - load_acquire(this->sq_head) >= this->sq_entries)
+    {
+        this->enter(0);
+        tail = *this->sq_tail;
+    }
+
+    unsigned index = tail & this->sq_mask;
+    io_uring_sqe *sqe = &this->sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    this->sq_array[index] = index;
+
+    store_release(this->sq_tail, tail + 1);
+    this->to_submit++;
+
+    return sqe;
+}
+
+uint64_t UringEngine::add_operation(IoCallback callback)
+{
+    uint32_t slot;
+    if (this->free_operations.empty())
+    {
+        slot = this->operations.size();
+        this->operations.emplace_back();
+    }
+    else
+    {
+        slot = this->free_operations.back();
+        this->free_operations.pop_back();
+    }
+
+    this->operations[slot].callback = std::move(callback);
+    this->in_flight++;
+
+    return static_cast<uint64_t>(slot) + 1;
+}
+
+void UringEngine::enter(unsigned min_complete)
+{
+    unsigned flags = (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+    while (true)
+    {
+        int submitted = io_uring_enter(this->ring_fd, this->to_submit, min_complete, flags);
+        if (submitted >= 0)
+        {
+            this->to_submit -= submitted;
+            return;
+        }
+
+        if (errno == EINTR)
+        {
+            continue;
+        }
+
+        if (errno == EBUSY || errno == EAGAIN)
+        {
+            // the completion queue is full, make room before submitting more
+            this->reap_completions();
+            continue;
+        }
+
+        throw std::runtime_error("io_uring_enter failed: " + std::string(std::strerror(errno)));
+    }
+}
+
+void UringEngine::reap_completions()
+{
+    unsigned head = *this->cq_head;
+
+    while (head != load_acquire(this->cq_tail))
+    {
+        io_uring_cqe cqe = this->cqes[head & this->cq_mask];
+        head++;
+        store_release(this->cq_head, head);
+
+        if (cqe.user_data == WAKEUP_USER_DATA)
+        {
+            this->run_posted_tasks();
+            this->arm_wakeup();
+            continue;
+        }
+
+        if (cqe.user_data == TIMER_USER_DATA)
+        {
+            // expired timers run at the top of the next round of run()
+            this->timeout_armed = false;
+            continue;
+        }
+
+        if (cqe.user_data == PROBE_USER_DATA)
+        {
+            this->cancel_by_fd = cqe.res >= 0;
+            continue;
+        }
+
+        if (cqe.user_data == CANCEL_USER_DATA)
+        {
+            // the cancelled operations complete on their own
+            continue;
+        }
+
+        uint32_t slot = static_cast<uint32_t>(cqe.user_data - 1);
+        IoCallback callback = std::move(this->operations[slot].callback);
+        this->operations[slot].callback = nullptr;
+        this->free_operations.push_back(slot);
+        this->in_flight--;
+
+        if (callback)
+        {
+            callback(cqe.res);
+        }
+
+        head = *this->cq_head;
+    }
+}
+
+void UringEngine::arm_wakeup()
+{
+    io_uring_sqe *sqe = this->get_sqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = this->wakeup_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&this->wakeup_value);
+    sqe->len = sizeof(this->wakeup_value);
+    sqe->user_data = WAKEUP_USER_DATA;
+}
+
+void UringEngine::arm_timeout()
+{
+    std::optional<TimerQueue::clock::time_point> deadline = this->timers.next_deadline();
+    if (!deadline || (this->timeout_armed && this->armed_deadline <= *deadline))
+    {
+        return;
+    }
+
+    auto remaining = std::max(*deadline - TimerQueue::clock::now(), TimerQueue::clock::duration::zero());
+    auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count();
+    this->timeout_spec.tv_sec = nanoseconds / 1000000000;
+    this->timeout_spec.tv_nsec = nanoseconds % 1000000000;
+
+    // the kernel reads the timespec when the entry is submitted, by the next enter() and before timeout_spec is reused
+    io_uring_sqe *sqe = this->get_sqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = reinterpret_cast<uint64_t>(&this->timeout_spec);
+    sqe->len = 1;
+    sqe->user_data = TIMER_USER_DATA;
+
+    this->timeout_armed = true;
+    this->armed_deadline = *deadline;
+}
+
+void UringEngine::run_posted_tasks()
+{
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(this->posted_tasks_mutex);
+        tasks.swap(this->posted_tasks);
+    }
+
+    for (auto &task : tasks)
+    {
+        task();
+    }
+}
+
+bool UringEngine::is_registered(const uint8_t *buffer)
+{
+    return this->buffers_registered && buffer >= this->buffer_arena && buffer < this->buffer_arena + BUFFER_SLOT_SIZE * BUFFER_SLOTS;
+}
+
+void UringEngine::connect(int fd, const sockaddr_in *address, IoCallback callback)
+{
+    // the ring waits for the socket itself, a non-blocking socket would only fail with EAGAIN
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+
+    uint64_t user_data = this->add_operation(std::move(callback));
+    Operation &operation = this->operations[user_data - 1];
+    operation.address = *address;
+
+    io_uring_sqe *sqe = this->get_sqe();
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&operation.address);
+    sqe->off = sizeof(operation.address);
+    sqe->user_data = user_data;
+}
+
+void UringEngine::read(int fd, uint8_t *buffer, size_t size, IoCallback callback)
+{
+    io_uring_sqe *sqe = this->get_sqe();
+    if (this->is_registered(buffer))
+    {
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->buf_index = 0;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_RECV;
+    }
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = size;
+    sqe->user_data = this->add_operation(std::move(callback));
+}
+
+void UringEngine::write(int fd, const uint8_t *data, size_t size, IoCallback callback)
+{
+    io_uring_sqe *sqe = this->get_sqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = this->add_operation(std::move(callback));
+}
+
+void UringEngine::cancel(int fd)
+{
+    // pending socket operations complete with an error once the socket is shut down
+    shutdown(fd, SHUT_RDWR);
+
+    // except a connect still in progress, e.g. one that timed out, which the ring would wait on for minutes
+    io_uring_sqe *sqe = this->get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = CANCEL_USER_DATA;
+}
+
+uint8_t *UringEngine::acquire_buffer(size_t size)
+{
+    if (size <= BUFFER_SLOT_SIZE && !this->free_buffers.empty())
+    {
+        uint8_t *buffer = this->free_buffers.back();
+        this->free_buffers.pop_back();
+        return buffer;
+    }
+
+    return new uint8_t[size];
+}
+
+void UringEngine::release_buffer(uint8_t *buffer, size_t)
+{
+    if (this->buffer_arena != nullptr && buffer >= this->buffer_arena && buffer < this->buffer_arena + BUFFER_SLOT_SIZE * BUFFER_SLOTS)
+    {
+        this->free_buffers.push_back(buffer);
+        return;
+    }
+
+    delete[] buffer;
+}
+
+void UringEngine::post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->posted_tasks_mutex);
+        this->posted_tasks.push_back(std::move(task));
+    }
+
+    uint64_t one = 1;
+    ssize_t iResult = ::write(this->wakeup_fd, &one, sizeof(one));
+    (void)iResult;
+}
+
+void UringEngine::add_timer(std::chrono::steady_clock::duration delay, std::function<void()> task)
+{
+    this->timers.add(delay, std::move(task));
+}
+
+void UringEngine::stop()
+{
+    this->post([this]()
+               { this->stopped = true; });
+}
+
+void UringEngine::run()
+{
+    while (!this->stopped)
+    {
+        this->reap_completions();
+        this->timers.run_expired();
+
+        if (this->stopped)
+        {
+            break;
+        }
+
+        if (this->in_flight == 0)
+        {
+            std::lock_guard<std::mutex> lock(this->posted_tasks_mutex);
+            if (this->posted_tasks.empty())
+            {
+                break;
+            }
+        }
+
+        this->arm_timeout();
+
+        // one syscall submits everything queued since the last round and waits for the next completion
+        this->enter(1);
+    }
+}
+
+#endif
@@ -0,0 +1,173 @@
+#pragma once
+
+#ifdef BITTORRENT_IO_URING
+
+#include <linux/io_uring.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "client/ioEngine.hpp"
+#include "client/timerQueue.hpp"
+
+// io_uring backend of the IoEngine, the socket reads and writes of all connections share one submission queue
+class UringEngine : public IoEngine
+{
+private:
+    struct Operation
+    {
+        IoCallback callback;
+        sockaddr_in address; // connect reads the address asynchronously
+    };
+
+    static constexpr unsigned QUEUE_DEPTH = 1024;
+    static constexpr uint64_t WAKEUP_USER_DATA = 0;
+    static constexpr uint64_t TIMER_USER_DATA = ~uint64_t(0);
+    static constexpr uint64_t CANCEL_USER_DATA = ~uint64_t(0) - 1;
+    static constexpr uint64_t PROBE_USER_DATA = ~uint64_t(0) - 2;
+
+    // registered read buffers, every slot holds one connection's input buffer
+    static constexpr size_t BUFFER_SLOT_SIZE = 256 * 1024;
+    static constexpr size_t BUFFER_SLOTS = 64;
+
+    int ring_fd;
+
+    // submission queue
+    void *sq_ring;
+    size_t sq_ring_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned *sq_array;
+    io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned to_submit;
+
+    // completion queue
+    void *cq_ring;
+    size_t cq_ring_size;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe *cqes;
+
+    // callbacks of in-flight operations, the slot index (+1) is the user_data of the submission
+    std::deque<Operation> operations; // a deque keeps the connect addresses in place while it grows
+    std::vector<uint32_t> free_operations;
+    size_t in_flight;
+
+    uint8_t *buffer_arena;
+    bool buffers_registered;
+    std::vector<uint8_t *> free_buffers;
+
+    // cancel() cancels by file descriptor, which needs Linux 5.19, probed when the ring is set up
+    bool cancel_by_fd;
+
+    int wakeup_fd;
+    uint64_t wakeup_value;
+    bool stopped;
+    std::mutex posted_tasks_mutex;
+    std::vector<std::function<void()>> posted_tasks;
+
+    // a single ring timeout is armed for the earliest timer, one armed for a later deadline just fires early
+    TimerQueue timers;
+    bool timeout_armed;
+    TimerQueue::clock::time_point armed_deadline;
+    __kernel_timespec timeout_spec;
+
+    /**
+     * @brief returns a free submission queue entry, submitting the queued ones if the queue is full
+     *
+     * @return io_uring_sqe*
+     */
+    io_uring_sqe *get_sqe();
+
+    /**
+     * @brief stores the callback of a new operation and returns its user_data
+     *
+     * @param callback
+     * @return uint64_t
+     */
+    uint64_t add_operation(IoCallback callback);
+
+    /**
+     * @brief submits the queued entries and waits for at least min_complete completions
+     *
+     * @param min_complete
+     */
+    void enter(unsigned min_complete);
+
+    /**
+     * @brief runs the callbacks of all available completions
+     *
+     */
+    void reap_completions();
+
+    /**
+     * @brief queues a read on the eventfd other threads use to wake the engine up
+     *
+     */
+    void arm_wakeup();
+
+    /**
+     * @brief runs the tasks posted from other threads
+     *
+     */
+    void run_posted_tasks();
+
+    /**
+     * @brief queues a ring timeout for the earliest timer unless one for that deadline or earlier is armed
+     *
+     */
+    void arm_timeout();
+
+    /**
+     * @brief returns true if the buffer lies in the registered arena
+     *
+     * @param buffer
+     * @return true
+     * @return false
+     */
+    bool is_registered(const uint8_t *buffer);
+
+public:
+    /**
+     * @brief sets up the ring and registers the read buffer arena
+     *
+     */
+    UringEngine();
+
+    UringEngine(const UringEngine &) = delete;
+    UringEngine &operator=(const UringEngine &) = delete;
+
+    /**
+     * @brief tears down the ring
+     *
+     */
+    ~UringEngine() override;
+
+    /**
+     * @brief returns true if the kernel can cancel the operations of a file descriptor (Linux 5.19 or later),
+     * the engine can't abort connects without it and shouldn't be used
+     *
+     * @return true
+     * @return false
+     */
+    bool supports_cancel_by_fd();
+
+    void connect(int fd, const sockaddr_in *address, IoCallback callback) override;
+    void read(int fd, uint8_t *buffer, size_t size, IoCallback callback) override;
+    void write(int fd, const uint8_t *data, size_t size, IoCallback callback) override;
+    void cancel(int fd) override;
+    uint8_t *acquire_buffer(size_t size) override;
+    void release_buffer(uint8_t *buffer, size_t size) override;
+    void post(std::function<void()> task) override;
+    void add_timer(std::chrono::steady_clock::duration delay, std::function<void()> task) override;
+    void stop() override;
+    void run() override;
+};
+
+#endif
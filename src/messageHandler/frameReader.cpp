@@ -0,0 +1,186 @@
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "messageHandler/frameReader.hpp"
+
+FrameReader::FrameReader(size_t capacity)
+{
+    // allocated on the first read, connections driven by an I/O engine never read through it
+    this->buffer = nullptr;
+    this->capacity = capacity;
+    this->owns_buffer = true;
+    this->start = 0;
+    this->end = 0;
+}
+
+FrameReader::FrameReader(uint8_t *buffer, size_t capacity)
+{
+    this->buffer = buffer;
+    this->capacity = capacity;
+    this->owns_buffer = false;
+    this->start = 0;
+    this->end = 0;
+}
+
+FrameReader::FrameReader(FrameReader &&other)
+    : buffer(other.buffer), capacity(other.capacity), owns_buffer(other.owns_buffer), start(other.start), end(other.end)
+{
+    other.buffer = nullptr;
+    other.owns_buffer = false;
+    other.start = other.end = 0;
+}
+
+FrameReader::~FrameReader()
+{
+    if (this->owns_buffer)
+    {
+        delete[] this->buffer;
+    }
+}
+
+uint8_t *FrameReader::prepare()
+{
+    if (this->buffer == nullptr)
+    {
+        this->buffer = new uint8_t[this->capacity];
+    }
+
+    if (this->start == this->end)
+    {
+        this->start = this->end = 0;
+    }
+    else if (this->capacity - this->end < this->capacity / 4)
+    {
+        // move the partial message to the front to make room for the rest
+        std::memmove(this->buffer, this->buffer + this->start, this->end - this->start);
+        this->end -= this->start;
+        this->start = 0;
+    }
+
+    if (this->end == this->capacity)
+    {
+        throw std::runtime_error("Message does not fit into the receive buffer");
+    }
+
+    return this->buffer + this->end;
+}
+
+size_t FrameReader::writable_size()
+{
+    return this->capacity - this->end;
+}
+
+void FrameReader::commit(size_t size)
+{
+    this->end += size;
+}
+
+size_t FrameReader::buffered()
+{
+    return this->end - this->start;
+}
+
+bool FrameReader::next_handshake(std::string_view &handshake)
+{
+    if (this->buffered() < HANDSHAKE_LENGTH)
+    {
+        return false;
+    }
+
+    handshake = std::string_view(reinterpret_cast<const char *>(this->buffer + this->start), HANDSHAKE_LENGTH);
+    this->start += HANDSHAKE_LENGTH;
+
+    return true;
+}
+
+bool FrameReader::next_message(MessageView &message)
+{
+    while (this->buffered() >= 4)
+    {
+        const uint8_t *frame = this->buffer + this->start;
+
+        uint32_t length;
+        std::memcpy(&length, frame, sizeof(length));
+        length = ntohl(length);
+
+        if (length == 0)
+        {
+            // keep-alive
+            this->start += 4;
+            continue;
+        }
+
+        if (4 + static_cast<size_t>(length) > this->capacity)
+        {
+            throw std::runtime_error("Message of " + std::to_string(length) + " bytes does not fit into the receive buffer");
+        }
+
+        if (this->buffered() < 4 + static_cast<size_t>(length))
+        {
+            return false;
+        }
+
+        message.type = static_cast<MessageType>(frame[4]);
+        message.length = length;
+        message.payload = frame + 5;
+        message.payload_size = length - 1;
+
+        this->start += 4 + length;
+        return true;
+    }
+
+    return false;
+}
+
+bool FrameReader::peek_partial_block(BlockView &received, uint32_t &block_length)
+{
+    // length prefix, message ID, piece index and begin offset
+    const size_t HEADER_SIZE = 13;
+
+    // skip keep-alives
+    while (this->buffered() >= 4)
+    {
+        uint32_t length;
+        std::memcpy(&length, this->buffer + this->start, sizeof(length));
+        if (length != 0)
+        {
+            break;
+        }
+        this->start += 4;
+    }
+
+    if (this->buffered() < HEADER_SIZE)
+    {
+        return false;
+    }
+
+    const uint8_t *frame = this->buffer + this->start;
+    uint32_t length, index, begin;
+    std::memcpy(&length, frame, sizeof(length));
+    std::memcpy(&index, frame + 5, sizeof(index));
+    std::memcpy(&begin, frame + 9, sizeof(begin));
+    length = ntohl(length);
+
+    if (static_cast<MessageType>(frame[4]) != MessageType::PIECE || length < HEADER_SIZE - 4 || this->buffered() >= 4 + static_cast<size_t>(length))
+    {
+        return false;
+    }
+
+    received.index = ntohl(index);
+    received.begin = ntohl(begin);
+    received.data = frame + HEADER_SIZE;
+    received.size = this->buffered() - HEADER_SIZE;
+    block_length = length - (HEADER_SIZE - 4);
+
+    return true;
+}
+
+void FrameReader::consume_partial_block()
+{
+    // the message is incomplete, so all buffered bytes belong to it
+    this->start = this->end;
+}
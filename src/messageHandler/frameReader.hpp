@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+#include "messageHandler/message.hpp"
+
+// Receive buffer of a peer connection that splits the byte stream into wire messages.
+// The socket is read in large chunks, messages are handed out as views into the buffer,
+// and only the tail of a partial message is moved to the front when the buffer runs full,
+// which keeps every message contiguous (unlike a wrap-around ring buffer).
+// The rest of a block whose PIECE header already arrived can bypass the buffer (see peek_partial_block()).
+class FrameReader
+{
+private:
+    uint8_t *buffer;
+    size_t capacity;
+    bool owns_buffer;
+
+    // received bytes not parsed yet are buffer[start, end)
+    size_t start;
+    size_t end;
+
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+    static constexpr size_t HANDSHAKE_LENGTH = 68;
+
+    /**
+     * @brief creates a reader with its own buffer, allocated on the first prepare()
+     *
+     * @param capacity
+     */
+    FrameReader(size_t capacity = DEFAULT_CAPACITY);
+
+    /**
+     * @brief creates a reader over a buffer owned by the caller (e.g. registered with the I/O engine)
+     *
+     * @param buffer
+     * @param capacity
+     */
+    FrameReader(uint8_t *buffer, size_t capacity);
+
+    FrameReader(FrameReader &&other);
+    FrameReader(const FrameReader &) = delete;
+    FrameReader &operator=(const FrameReader &) = delete;
+
+    /**
+     * @brief frees the buffer if the reader owns it
+     *
+     */
+    ~FrameReader();
+
+    /**
+     * @brief makes room for the next read and returns where it should go, invalidates the views handed out so far
+     *
+     * @return uint8_t*
+     */
+    uint8_t *prepare();
+
+    /**
+     * @brief returns how many bytes the next read may store at the position returned by prepare()
+     *
+     * @return size_t
+     */
+    size_t writable_size();
+
+    /**
+     * @brief marks bytes stored after prepare() as received
+     *
+     * @param size
+     */
+    void commit(size_t size);
+
+    /**
+     * @brief returns the number of received bytes not parsed yet
+     *
+     * @return size_t
+     */
+    size_t buffered();
+
+    /**
+     * @brief takes the 68 byte handshake if it was received completely
+     *
+     * @param handshake set to a view of the handshake
+     * @return true if the handshake was complete
+     * @return false if more bytes are needed
+     */
+    bool next_handshake(std::string_view &handshake);
+
+    /**
+     * @brief takes the next complete message, keep-alives are consumed and skipped
+     *
+     * @param message set to a view of the message
+     * @return true if a message was complete
+     * @return false if more bytes are needed
+     */
+    bool next_message(MessageView &message);
+
+    /**
+     * @brief checks whether the next message is a PIECE whose header was received but not all of its block,
+     * so the rest of the block can be received straight into its destination instead of this buffer
+     *
+     * @param received set to the block's index, begin and the part of the block received so far
+     * @param block_length set to the full length of the block
+     * @return true if the next message is such a partly received PIECE
+     * @return false
+     */
+    bool peek_partial_block(BlockView &received, uint32_t &block_length);
+
+    /**
+     * @brief consumes the partly received PIECE found by peek_partial_block(), the caller receives the rest of the block
+     *
+     */
+    void consume_partial_block();
+};
@@ -1,6 +1,7 @@
 #include <cstdint>
 #include <vector>
 #include <arpa/inet.h>
+#include <cstring>
 
 #include "messageHandler/message.hpp"
 #include <stdexcept>
@@ -53,4 +54,58 @@ Block Message::get_block()
     result.data = std::vector<uint8_t>(this->payload.begin() + DATA_OFFSET, this->payload.end());
 
     return result;
-}
\ No newline at end of file
+}
+
+BlockView MessageView::get_block() const
+{
+    BlockView result;
+
+    if (this->type != MessageType::PIECE)
+    {
+        throw std::runtime_error("Not a PIECE message");
+    }
+
+    // payload is of the form: <index><begin><block>
+    constexpr uint32_t INDEX_OFFSET = 0;
+    constexpr uint32_t BEGIN_OFFSET = 4;
+    constexpr uint32_t DATA_OFFSET = 8;
+
+    if (this->payload_size < DATA_OFFSET)
+    {
+        throw std::runtime_error("Piece message payload too short");
+    }
+
+    uint32_t index, begin;
+    std::memcpy(&index, this->payload + INDEX_OFFSET, sizeof(index));
+    std::memcpy(&begin, this->payload + BEGIN_OFFSET, sizeof(begin));
+
+    result.index = ntohl(index);
+    result.begin = ntohl(begin);
+    result.data = this->payload + DATA_OFFSET;
+    result.size = this->payload_size - DATA_OFFSET;
+
+    return result;
+}
+
+uint32_t MessageView::get_have_index() const
+{
+    if (this->type != MessageType::HAVE)
+    {
+        throw std::runtime_error("Not a HAVE message");
+    }
+
+    if (this->payload_size != 4)
+    {
+        throw std::runtime_error("Invalid have message payload length: " + std::to_string(this->payload_size));
+    }
+
+    uint32_t index;
+    std::memcpy(&index, this->payload, sizeof(index));
+
+    return ntohl(index);
+}
+
+Message MessageView::to_message() const
+{
+    return Message(this->type, this->length, std::vector<uint8_t>(this->payload, this->payload + this->payload_size));
+}
@@ -68,4 +68,42 @@ public:
      * @return Block
      */
     Block get_block();
-};
\ No newline at end of file
+};
+
+struct BlockView
+{
+    uint32_t index;
+    uint32_t begin;
+    const uint8_t *data;
+    size_t size;
+};
+
+// a message that points into the buffer it was received in, valid until that buffer is refilled
+struct MessageView
+{
+    MessageType type;
+    uint32_t length;
+    const uint8_t *payload;
+    size_t payload_size;
+
+    /**
+     * @brief Parse the payload of the piece message and return a block view pointing into the payload
+     *
+     * @return BlockView
+     */
+    BlockView get_block() const;
+
+    /**
+     * @brief Parse the payload of the have message and return the piece index
+     *
+     * @return uint32_t
+     */
+    uint32_t get_have_index() const;
+
+    /**
+     * @brief Copy the viewed message into an owning Message object
+     *
+     * @return Message
+     */
+    Message to_message() const;
+};
@@ -7,19 +7,98 @@
 #include <cstdint>
 #include <vector>
 #include <arpa/inet.h>
+#include <optional>
+#include <string_view>
 
 #include "messageHandler/messageHandler.hpp"
 #include "messageHandler/message.hpp"
+#include "messageHandler/messageWriter.hpp"
+#include "messageHandler/outputBuffer.hpp"
 #include "metainfo/metainfo.hpp"
-#include "bencode/decode.hpp"
+#include "bencode/streamParser.hpp"
 
-using namespace std::string_literals;
+namespace
+{
+    // picks the compact peer list and the failure reason out of a tracker response
+    class TrackerResponseHandler : public BencodeHandler
+    {
+    private:
+        size_t depth = 0;
+        std::string root_key;
+
+    public:
+        std::optional<std::string> peers;
+        std::optional<std::string> failure_reason;
+
+        void begin_dict() override
+        {
+            this->depth++;
+        }
+
+        void begin_list() override
+        {
+            this->depth++;
+        }
+
+        void end() override
+        {
+            this->depth--;
+        }
+
+        void key(std::string_view key) override
+        {
+            if (this->depth == 1)
+            {
+                this->root_key = key;
+            }
+        }
+
+        void string(std::string_view fragment, bool) override
+        {
+            if (this->depth != 1)
+            {
+                return;
+            }
+
+            std::optional<std::string> *target = nullptr;
+            if (this->root_key == "peers")
+            {
+                target = &this->peers;
+            }
+            else if (this->root_key == "failure reason")
+            {
+                target = &this->failure_reason;
+            }
+
+            if (target != nullptr)
+            {
+                if (!*target)
+                {
+                    target->emplace();
+                }
+                (*target)->append(fragment);
+            }
+        }
+    };
+}
 
 std::vector<std::string> MessageHandler::parse_server_response(std::string response)
 {
-    Decode decode = Decode();
-    auto decoded_response = decode.decode_bencoded_value(response);
-    std::string peers_str = decoded_response["peers"].get<std::string>();
+    TrackerResponseHandler handler;
+    StreamParser parser(handler);
+    parser.feed(response);
+    parser.finish();
+
+    if (handler.failure_reason)
+    {
+        throw std::runtime_error("Tracker request failed: " + *handler.failure_reason);
+    }
+    if (!handler.peers)
+    {
+        throw std::runtime_error("Tracker response has no compact peer list");
+    }
+
+    std::string peers_str = std::move(*handler.peers);
 
     std::vector<std::string> result; // represents the the peers IP addresses
 
@@ -77,77 +156,18 @@ std::string MessageHandler::parse_handshake_response(std::string response)
     return ss.str();
 }
 
-std::vector<uint8_t> MessageHandler::create_handshake_message(MetaInfo metaInfo)
+std::vector<uint8_t> MessageHandler::create_handshake_message(MetaInfo &metaInfo)
 {
-    std::string handshake_message = "\x13"s                               // length of the protocol string
-                                    + "BitTorrent protocol"s              // protocol string
-                                    + "\x00\x00\x00\x00\x00\x00\x00\x00"s // reserved
-                                    + metaInfo.get_info_string()          // info hash
-                                    + "00112233445566778899"s;            // peer id
-
-    std::vector<uint8_t> handshake_message_bytes(handshake_message.begin(), handshake_message.end());
+    OutputBuffer message;
+    MessageWriter::write_handshake(message, metaInfo);
 
-    return handshake_message_bytes;
+    return std::vector<uint8_t>(message.data(), message.data() + message.size());
 }
 
 std::vector<uint8_t> MessageHandler::create_interested_message()
 {
-    // const uint8_t INTERESTED_MESSAGE_ID = 2;
-    std::vector<uint8_t> interested_message;
-    std::vector<uint8_t> payload;
-    uint32_t total_length = 4                 // message length (4 bytes)
-                            + 1               // message ID (1 byte)
-                            + payload.size(); // payload length (variable)
-
-    interested_message.reserve(total_length);
-
-    // actual message length
-    uint32_t networkLength = htonl(total_length - 4);
-
-    const uint8_t *lengthBytes = reinterpret_cast<const uint8_t *>(&networkLength);
-    interested_message.insert(interested_message.end(), lengthBytes, lengthBytes + sizeof(networkLength));
+    OutputBuffer message;
+    MessageWriter::write_signal(message, MessageType::INTERESTED);
 
-    interested_message.push_back(static_cast<uint8_t>(MessageType::INTERESTED));
-
-    interested_message.insert(interested_message.end(), payload.begin(), payload.end());
-
-    return interested_message;
+    return std::vector<uint8_t>(message.data(), message.data() + message.size());
 }
-
-std::vector<uint8_t> MessageHandler::create_request_message(uint32_t index, uint32_t begin, uint32_t length)
-{
-    std::vector<uint8_t> request_message;
-    std::vector<uint8_t> request_payload;
-    // const uint8_t REQUEST_MESSAGE_ID = 6;
-    uint32_t index_n = htonl(index);
-    uint32_t begin_n = htonl(begin);
-    uint32_t length_n = htonl(length);
-
-    uint32_t total_length = 4                       // message length (4 bytes)
-                            + 1                     // message ID (1 byte)
-                            + 3 * sizeof(uint32_t); // payload length (3 * 4 bytes)
-    request_message.reserve(total_length);
-
-    // actual message length
-    uint32_t networkLength = htonl(total_length - 4);
-
-    const uint8_t *messageLengthBytes = reinterpret_cast<const uint8_t *>(&networkLength);
-    request_message.insert(request_message.end(), messageLengthBytes, messageLengthBytes + sizeof(networkLength));
-
-    request_message.push_back(static_cast<uint8_t>(MessageType::REQUEST));
-
-    // add index_n , begin_n, length_n to the payload
-    request_payload.reserve(3 * sizeof(uint32_t));
-
-    const uint8_t *indexBytes = reinterpret_cast<const uint8_t *>(&index_n);
-    const uint8_t *beginBytes = reinterpret_cast<const uint8_t *>(&begin_n);
-    const uint8_t *lengthBytes = reinterpret_cast<const uint8_t *>(&length_n);
-
-    request_payload.insert(request_payload.end(), indexBytes, indexBytes + sizeof(index_n));
-    request_payload.insert(request_payload.end(), beginBytes, beginBytes + sizeof(begin_n));
-    request_payload.insert(request_payload.end(), lengthBytes, lengthBytes + sizeof(length_n));
-
-    request_message.insert(request_message.end(), request_payload.begin(), request_payload.end());
-
-    return request_message;
-}
\ No newline at end of file
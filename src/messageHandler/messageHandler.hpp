@@ -44,12 +44,13 @@ public:
     static std::string parse_handshake_response(std::string response);
 
     /**
-     * @brief creates a handshake message to send to the peer
+     * @brief creates a handshake message to send to the peer, connections that send more than a few messages
+     * serialize them into an OutputBuffer with MessageWriter instead
      *
      * @param metaInfo
-     * @return std::string
+     * @return std::vector<uint8_t>
      */
-    static std::vector<uint8_t> create_handshake_message(MetaInfo metaInfo);
+    static std::vector<uint8_t> create_handshake_message(MetaInfo &metaInfo);
 
     /**
      * @brief creates an interested message to send to the peer, where message id is 2 and payload is empty
@@ -57,11 +58,4 @@ public:
      * @return std::vector<uint8_t>
      */
     static std::vector<uint8_t> create_interested_message();
-
-    /**
-     * @brief creates a request message to send to the peer, where message id is 3 and payload contains the piece index, begin offset and length
-     *
-     * @return std::vector<uint8_t>
-     */
-    static std::vector<uint8_t> create_request_message(uint32_t index, uint32_t begin, uint32_t length);
 };
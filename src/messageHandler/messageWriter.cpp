@@ -0,0 +1,91 @@
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "messageHandler/messageWriter.hpp"
+
+namespace
+{
+    uint8_t *put_uint32(uint8_t *position, uint32_t value)
+    {
+        position[0] = static_cast<uint8_t>(value >> 24);
+        position[1] = static_cast<uint8_t>(value >> 16);
+        position[2] = static_cast<uint8_t>(value >> 8);
+        position[3] = static_cast<uint8_t>(value);
+        return position + 4;
+    }
+
+    // writes the length prefix (which counts the message ID and the payload) and the message ID
+    uint8_t *put_header(uint8_t *position, MessageType type, uint32_t payload_size)
+    {
+        position = put_uint32(position, payload_size + 1);
+        *position = static_cast<uint8_t>(type);
+        return position + 1;
+    }
+
+    void write_block_reference(OutputBuffer &output, MessageType type, uint32_t index, uint32_t begin, uint32_t length)
+    {
+        uint8_t *position = put_header(output.reserve(MessageWriter::BLOCK_REFERENCE_SIZE), type, 12);
+        position = put_uint32(position, index);
+        position = put_uint32(position, begin);
+        put_uint32(position, length);
+    }
+}
+
+void MessageWriter::write_handshake(OutputBuffer &output, MetaInfo &metaInfo)
+{
+    const std::string_view PROTOCOL = "\x13"
+                                      "BitTorrent protocol";
+    std::string_view info_hash = metaInfo.get_info_string();
+
+    uint8_t *position = output.reserve(HANDSHAKE_SIZE);
+    std::memcpy(position, PROTOCOL.data(), PROTOCOL.size());
+    std::memset(position + 20, 0, 8); // reserved
+    std::memcpy(position + 28, info_hash.data(), 20);
+    std::memcpy(position + 48, PEER_ID.data(), 20);
+}
+
+void MessageWriter::write_keep_alive(OutputBuffer &output)
+{
+    put_uint32(output.reserve(KEEP_ALIVE_SIZE), 0);
+}
+
+void MessageWriter::write_signal(OutputBuffer &output, MessageType type)
+{
+    if (type != MessageType::CHOKE && type != MessageType::UNCHOKE && type != MessageType::INTERESTED && type != MessageType::NOT_INTERESTED)
+    {
+        throw std::runtime_error("Message of ID " + std::to_string(static_cast<int>(type)) + " has a payload");
+    }
+
+    put_header(output.reserve(HEADER_SIZE), type, 0);
+}
+
+void MessageWriter::write_have(OutputBuffer &output, uint32_t index)
+{
+    put_uint32(put_header(output.reserve(HAVE_SIZE), MessageType::HAVE, 4), index);
+}
+
+void MessageWriter::write_bitfield(OutputBuffer &output, const uint8_t *bytes, size_t size)
+{
+    uint8_t *position = put_header(output.reserve(HEADER_SIZE + size), MessageType::BITFIELD, size);
+    std::memcpy(position, bytes, size);
+}
+
+void MessageWriter::write_request(OutputBuffer &output, uint32_t index, uint32_t begin, uint32_t length)
+{
+    write_block_reference(output, MessageType::REQUEST, index, begin, length);
+}
+
+void MessageWriter::write_cancel(OutputBuffer &output, uint32_t index, uint32_t begin, uint32_t length)
+{
+    write_block_reference(output, MessageType::CANCEL, index, begin, length);
+}
+
+void MessageWriter::write_piece_header(OutputBuffer &output, uint32_t index, uint32_t begin, uint32_t block_length)
+{
+    uint8_t *position = put_header(output.reserve(PIECE_HEADER_SIZE), MessageType::PIECE, 8 + block_length);
+    position = put_uint32(position, index);
+    put_uint32(position, begin);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+#include "metainfo/metainfo.hpp"
+#include "messageHandler/message.hpp"
+#include "messageHandler/outputBuffer.hpp"
+
+// Serializes wire messages straight into the output buffer of a connection, without temporaries.
+// The sizes of the fixed-length messages are known at compile time.
+class MessageWriter
+{
+public:
+    static constexpr std::string_view PEER_ID = "00112233445566778899";
+
+    static constexpr size_t HANDSHAKE_SIZE = 68;
+    static constexpr size_t KEEP_ALIVE_SIZE = 4;
+    // length prefix and message ID
+    static constexpr size_t HEADER_SIZE = 5;
+    static constexpr size_t HAVE_SIZE = HEADER_SIZE + 4;
+    // request and cancel: piece index, begin offset and length
+    static constexpr size_t BLOCK_REFERENCE_SIZE = HEADER_SIZE + 12;
+    // piece index and begin offset, the block follows
+    static constexpr size_t PIECE_HEADER_SIZE = HEADER_SIZE + 8;
+
+    /**
+     * @brief writes the handshake for the torrent
+     *
+     * @param output
+     * @param metaInfo
+     */
+    static void write_handshake(OutputBuffer &output, MetaInfo &metaInfo);
+
+    /**
+     * @brief writes a keep-alive, a message of length 0
+     *
+     * @param output
+     */
+    static void write_keep_alive(OutputBuffer &output);
+
+    /**
+     * @brief writes a message without payload: choke, unchoke, interested or not interested
+     *
+     * @param output
+     * @param type
+     */
+    static void write_signal(OutputBuffer &output, MessageType type);
+
+    /**
+     * @brief writes a have message announcing a piece
+     *
+     * @param output
+     * @param index
+     */
+    static void write_have(OutputBuffer &output, uint32_t index);
+
+    /**
+     * @brief writes a bitfield message with the given bitfield bytes
+     *
+     * @param output
+     * @param bytes
+     * @param size
+     */
+    static void write_bitfield(OutputBuffer &output, const uint8_t *bytes, size_t size);
+
+    /**
+     * @brief writes a request message for a block
+     *
+     * @param output
+     * @param index
+     * @param begin
+     * @param length
+     */
+    static void write_request(OutputBuffer &output, uint32_t index, uint32_t begin, uint32_t length);
+
+    /**
+     * @brief writes a cancel message for a block requested earlier
+     *
+     * @param output
+     * @param index
+     * @param begin
+     * @param length
+     */
+    static void write_cancel(OutputBuffer &output, uint32_t index, uint32_t begin, uint32_t length);
+
+    /**
+     * @brief writes the header of a piece message, the caller sends the block of block_length bytes right after it
+     *
+     * @param output
+     * @param index
+     * @param begin
+     * @param block_length
+     */
+    static void write_piece_header(OutputBuffer &output, uint32_t index, uint32_t begin, uint32_t block_length);
+};
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "messageHandler/outputBuffer.hpp"
+
+OutputBuffer::OutputBuffer()
+{
+    this->start = 0;
+    this->end = 0;
+}
+
+uint8_t *OutputBuffer::reserve(size_t size)
+{
+    if (this->end + size > this->storage.size())
+    {
+        // move the unsent tail of a partial send to the front before growing
+        if (this->start > 0)
+        {
+            std::memmove(this->storage.data(), this->storage.data() + this->start, this->end - this->start);
+            this->end -= this->start;
+            this->start = 0;
+        }
+
+        if (this->end + size > this->storage.size())
+        {
+            this->storage.resize(std::max(2 * this->storage.size(), this->end + size));
+        }
+    }
+
+    uint8_t *position = this->storage.data() + this->end;
+    this->end += size;
+    return position;
+}
+
+const uint8_t *OutputBuffer::data()
+{
+    return this->storage.data() + this->start;
+}
+
+size_t OutputBuffer::size()
+{
+    return this->end - this->start;
+}
+
+bool OutputBuffer::empty()
+{
+    return this->start == this->end;
+}
+
+void OutputBuffer::consume(size_t size)
+{
+    this->start += std::min(size, this->end - this->start);
+    if (this->start == this->end)
+    {
+        this->clear();
+    }
+}
+
+void OutputBuffer::clear()
+{
+    this->start = 0;
+    this->end = 0;
+}
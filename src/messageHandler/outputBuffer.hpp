@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Send buffer of a peer connection that messages are serialized into in place (see MessageWriter).
+// Everything queued goes out in one send, and the storage only grows, so once it holds the largest
+// batch a connection sends, queueing a message allocates nothing.
+class OutputBuffer
+{
+private:
+    std::vector<uint8_t> storage;
+
+    // queued bytes not sent yet are storage[start, end)
+    size_t start;
+    size_t end;
+
+public:
+    /**
+     * @brief creates an empty buffer, the storage is allocated by the first reserve()
+     *
+     */
+    OutputBuffer();
+
+    /**
+     * @brief appends size bytes to the buffer and returns where to write them, invalidates the pointers returned by data()
+     *
+     * @param size
+     * @return uint8_t*
+     */
+    uint8_t *reserve(size_t size);
+
+    /**
+     * @brief returns the queued bytes
+     *
+     * @return const uint8_t*
+     */
+    const uint8_t *data();
+
+    /**
+     * @brief returns the number of queued bytes
+     *
+     * @return size_t
+     */
+    size_t size();
+
+    /**
+     * @brief returns true if nothing is queued
+     *
+     * @return true
+     * @return false
+     */
+    bool empty();
+
+    /**
+     * @brief drops sent bytes from the front of the buffer
+     *
+     * @param size
+     */
+    void consume(size_t size);
+
+    /**
+     * @brief drops all queued bytes, keeping the storage
+     *
+     */
+    void clear();
+};
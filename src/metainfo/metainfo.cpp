@@ -1,4 +1,5 @@
 #include <iostream>
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <cctype>
@@ -7,22 +8,285 @@
 #include <fstream>
 #include <iomanip>
 #include <sstream>
+#include <optional>
+#include <utility>
+#include <string_view>
 
 #include "metainfo/metainfo.hpp"
-#include "bencode/decode.hpp"
-#include "bencode/encode.hpp"
-#include "metainfo/sha1.hpp"
+#include "bencode/streamParser.hpp"
+#include "metainfo/sha1Engine.hpp"
+
+namespace
+{
+    // picks the fields MetaInfo needs out of the torrent file without building the decoded tree
+    class MetaInfoHandler : public BencodeHandler
+    {
+    private:
+        StreamParser *parser;
+        size_t depth;
+        // keys of the enclosing dicts at depth 1 (root) and 2 (e.g. inside info)
+        std::string root_key;
+        std::string info_key;
+        // inside the list of files of a multi-file torrent, and the key of the file dict (depth 4) being read
+        bool in_files;
+        std::string file_key;
+        // a component of a file path arrived partly
+        bool in_path_component;
+
+        bool in_info()
+        {
+            return this->depth == 2 && this->root_key == "info";
+        }
+
+        bool in_file()
+        {
+            return this->in_files && this->depth == 4;
+        }
+
+        bool in_file_path()
+        {
+            return this->in_files && this->depth == 5 && this->file_key == "path";
+        }
+
+    public:
+        struct File
+        {
+            std::optional<int64_t> length;
+            std::vector<std::string> path;
+        };
+
+        std::optional<std::string> announce;
+        std::optional<std::string> name;
+        std::optional<std::string> pieces;
+        std::optional<int64_t> length;
+        std::optional<int64_t> piece_length;
+        std::optional<std::vector<File>> files;
+        std::optional<std::pair<size_t, size_t>> info_offsets;
+
+        MetaInfoHandler() : parser(nullptr), depth(0), in_files(false), in_path_component(false) {}
+
+        void set_parser(StreamParser &parser)
+        {
+            this->parser = &parser;
+        }
+
+        void begin_dict() override
+        {
+            this->depth++;
+            if (this->in_info())
+            {
+                this->info_key.clear();
+                this->info_offsets = {this->parser->get_value_start(), 0};
+            }
+            else if (this->in_file())
+            {
+                this->files->emplace_back();
+                this->file_key.clear();
+            }
+        }
+
+        void begin_list() override
+        {
+            if (this->in_info() && this->info_key == "files")
+            {
+                this->in_files = true;
+                this->files.emplace();
+            }
+            this->depth++;
+        }
+
+        void end() override
+        {
+            if (this->in_info() && this->info_offsets)
+            {
+                this->info_offsets->second = this->parser->get_position();
+            }
+            else if (this->in_files && this->depth == 3)
+            {
+                this->in_files = false;
+            }
+            this->depth--;
+        }
+
+        void key(std::string_view key) override
+        {
+            if (this->depth == 1)
+            {
+                this->root_key = key;
+            }
+            else if (this->in_info())
+            {
+                this->info_key = key;
+            }
+            else if (this->in_file())
+            {
+                this->file_key = key;
+            }
+        }
+
+        void integer(int64_t value) override
+        {
+            if (this->in_info() && this->info_key == "length")
+            {
+                this->length = value;
+            }
+            else if (this->in_info() && this->info_key == "piece length")
+            {
+                this->piece_length = value;
+            }
+            else if (this->in_file() && this->file_key == "length")
+            {
+                this->files->back().length = value;
+            }
+        }
+
+        void string(std::string_view fragment, bool last) override
+        {
+            if (this->in_file_path())
+            {
+                std::vector<std::string> &path = this->files->back().path;
+                if (!this->in_path_component)
+                {
+                    path.emplace_back();
+                }
+                path.back().append(fragment);
+                this->in_path_component = !last;
+                return;
+            }
+
+            std::optional<std::string> *target = nullptr;
+            if (this->depth == 1 && this->root_key == "announce")
+            {
+                target = &this->announce;
+            }
+            else if (this->in_info() && this->info_key == "name")
+            {
+                target = &this->name;
+            }
+            else if (this->in_info() && this->info_key == "pieces")
+            {
+                target = &this->pieces;
+            }
+
+            if (target != nullptr)
+            {
+                if (!*target)
+                {
+                    target->emplace();
+                }
+                (*target)->append(fragment);
+            }
+        }
+    };
+
+    template <typename T>
+    T required(std::optional<T> &field, const std::string &name)
+    {
+        if (!field)
+        {
+            throw std::runtime_error("Torrent file has no " + name);
+        }
+
+        return std::move(*field);
+    }
+
+    // a path component may not leave the directory of the torrent or be empty
+    bool is_valid_path_component(const std::string &component)
+    {
+        return !component.empty() && component != "." && component != ".." &&
+               component.find('/') == std::string::npos && component.find('\0') == std::string::npos;
+    }
+}
 
 MetaInfo::MetaInfo(std::filesystem::path torrent_file)
 {
     std::string encoded_value = this->read_file(torrent_file);
-    Decode decode = Decode();
-    json metaInfo = decode.decode_bencoded_value(encoded_value);
-    this->announceURL = metaInfo["announce"];
-    this->file_size = metaInfo["info"]["length"];
-    this->name = metaInfo["info"]["name"];
-    this->piece_length = metaInfo["info"]["piece length"];
-    this->pieces_hash = metaInfo["info"]["pieces"];
+
+    MetaInfoHandler handler;
+    StreamParser parser(handler);
+    handler.set_parser(parser);
+    parser.feed(encoded_value);
+    parser.finish();
+
+    int64_t piece_length = required(handler.piece_length, "piece length");
+    if (piece_length <= 0)
+    {
+        throw std::runtime_error("Invalid piece length in the torrent file");
+    }
+
+    this->announceURL = required(handler.announce, "announce");
+    this->name = required(handler.name, "name");
+    this->piece_length = piece_length;
+
+    // a torrent has either a length (single file) or a list of files
+    this->multi_file = !handler.length && handler.files;
+    if (this->multi_file)
+    {
+        if (!is_valid_path_component(this->name))
+        {
+            throw std::runtime_error("Invalid name in the torrent file: " + this->name);
+        }
+
+        this->file_size = 0;
+        for (auto &file : *handler.files)
+        {
+            int64_t length = required(file.length, "file length");
+            if (length < 0 || file.path.empty() || !std::all_of(file.path.begin(), file.path.end(), is_valid_path_component))
+            {
+                throw std::runtime_error("Invalid file length or path in the torrent file");
+            }
+
+            std::string path = file.path.front();
+            for (size_t i = 1; i < file.path.size(); ++i)
+            {
+                path += "/" + file.path[i];
+            }
+
+            this->files.push_back(TorrentFile{path, static_cast<size_t>(length)});
+            this->file_size += length;
+        }
+    }
+    else
+    {
+        int64_t length = required(handler.length, "length");
+        if (length < 0)
+        {
+            throw std::runtime_error("Invalid length in the torrent file");
+        }
+
+        this->file_size = length;
+        this->files.push_back(TorrentFile{this->name, this->file_size});
+    }
+    this->pieces_hash = required(handler.pieces, "pieces");
+    auto [info_begin, info_end] = required(handler.info_offsets, "info dict");
+
+    if (this->pieces_hash.size() % 20 != 0)
+    {
+        throw std::runtime_error("Invalid pieces hash length: " + std::to_string(this->pieces_hash.size()));
+    }
+
+    // every piece but the last is piece_length long, so the hashes must cover the files exactly,
+    // otherwise the length of the last piece comes out wrong (or underflows)
+    size_t number_of_pieces = this->pieces_hash.size() / 20;
+    size_t expected_pieces = this->file_size / this->piece_length + (this->file_size % this->piece_length != 0);
+    if (number_of_pieces == 0)
+    {
+        throw std::runtime_error("Torrent file has no pieces");
+    }
+
+    if (number_of_pieces != expected_pieces)
+    {
+        throw std::runtime_error("Invalid number of pieces in the torrent file: " + std::to_string(number_of_pieces) + ", expected " + std::to_string(expected_pieces) + " for " + std::to_string(this->file_size) + " bytes");
+    }
+
+    this->piece_hashes.resize(number_of_pieces);
+    for (size_t i = 0; i < this->piece_hashes.size(); ++i)
+    {
+        std::copy_n(this->pieces_hash.begin() + i * 20, 20, this->piece_hashes[i].begin());
+    }
+
+    // hash the info dict exactly as it was encoded, keys we don't decode (private, source...) are part of the hash
+    this->info_hash = Sha1Engine::hash(reinterpret_cast<const uint8_t *>(encoded_value.data()) + info_begin, info_end - info_begin);
 }
 
 std::string MetaInfo::read_file(std::filesystem::path torrent_file)
@@ -56,11 +320,37 @@ std::string MetaInfo::get_name()
     return this->name;
 }
 
+const std::vector<TorrentFile> &MetaInfo::get_files()
+{
+    return this->files;
+}
+
+bool MetaInfo::is_multi_file()
+{
+    return this->multi_file;
+}
+
 size_t MetaInfo::get_piece_length()
 {
     return this->piece_length;
 }
 
+size_t MetaInfo::get_piece_length(size_t piece_index)
+{
+    size_t number_of_pieces = this->piece_hashes.size();
+    if (piece_index >= number_of_pieces)
+    {
+        throw std::runtime_error("Invalid piece index: " + std::to_string(piece_index));
+    }
+
+    if (piece_index == number_of_pieces - 1)
+    {
+        return this->file_size - piece_index * this->piece_length;
+    }
+
+    return this->piece_length;
+}
+
 std::string MetaInfo::stringToHex(const std::string &input)
 {
     std::stringstream hex_stream;
@@ -74,15 +364,27 @@ std::string MetaInfo::stringToHex(const std::string &input)
     return hex_stream.str();
 }
 
+size_t MetaInfo::get_number_of_pieces()
+{
+    return this->piece_hashes.size();
+}
+
+const PieceHash &MetaInfo::get_piece_hash(size_t piece_index)
+{
+    if (piece_index >= this->piece_hashes.size())
+    {
+        throw std::runtime_error("Invalid piece index: " + std::to_string(piece_index));
+    }
+
+    return this->piece_hashes[piece_index];
+}
+
 std::vector<std::string> MetaInfo::get_pieces_hash()
 {
     std::vector<std::string> result;
-    auto it = this->pieces_hash.begin();
-
-    while (it != this->pieces_hash.end())
+    for (const PieceHash &hash : this->piece_hashes)
     {
-        result.push_back(this->stringToHex(std::string(it, it + 20)));
-        it += 20;
+        result.push_back(this->stringToHex(std::string(hash.begin(), hash.end())));
     }
 
     return result;
@@ -101,39 +403,37 @@ std::string MetaInfo::to_string()
 json MetaInfo::to_json()
 {
     json j = {
-        {"length", this->file_size},
         {"name", this->name},
         {"piece length", this->piece_length},
         {"pieces", this->pieces_hash}};
 
+    if (!this->multi_file)
+    {
+        j["length"] = this->file_size;
+        return j;
+    }
+
+    j["files"] = json::array();
+    for (const TorrentFile &file : this->files)
+    {
+        json path = json::array();
+        for (size_t start = 0, end; start <= file.path.size(); start = end + 1)
+        {
+            end = std::min(file.path.find('/', start), file.path.size());
+            path.push_back(file.path.substr(start, end - start));
+        }
+        j["files"].push_back({{"length", file.length}, {"path", path}});
+    }
+
     return j;
 }
 
 std::string MetaInfo::get_info_hash()
 {
-    json info = this->to_json();
-    Encode encode = Encode();
-    std::string encoded_info = encode.encode_bencoded_value(info);
-    SHA1 checksum;
-    checksum.update(encoded_info);
-
-    return checksum.final();
+    return this->stringToHex(std::string(this->get_info_string()));
 }
 
-std::string MetaInfo::get_info_string()
+std::string_view MetaInfo::get_info_string()
 {
-    std::string info_hash = this->get_info_hash();
-
-    std::vector<uint8_t> bytes;
-
-    for (unsigned int i = 0; i < info_hash.length(); i += 2)
-    {
-        std::string byteString = info_hash.substr(i, 2);
-        char byte = (char)strtol(byteString.c_str(), NULL, 16);
-        bytes.push_back(byte);
-    }
-
-    std::string info_string = std::string(reinterpret_cast<char *>(bytes.data()), bytes.size() * sizeof(uint8_t));
-
-    return info_string;
-}
\ No newline at end of file
+    return std::string_view(reinterpret_cast<const char *>(this->info_hash.data()), this->info_hash.size());
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <filesystem>
 
@@ -8,6 +11,17 @@
 
 using json = nlohmann::json;
 
+// binary SHA-1 digest of a piece or of the info dictionary
+using PieceHash = std::array<uint8_t, 20>;
+
+// a file of the torrent, the files are laid out back to back in the order they are listed
+struct TorrentFile
+{
+    // relative path, the components joined by '/'
+    std::string path;
+    size_t length;
+};
+
 class MetaInfo
 {
 private:
@@ -16,6 +30,13 @@ private:
     std::string name;
     size_t piece_length;
     std::string pieces_hash;
+    // the files of a multi-file torrent, a single file named after the torrent otherwise
+    std::vector<TorrentFile> files;
+    bool multi_file;
+
+    // computed once when the torrent is loaded
+    PieceHash info_hash;
+    std::vector<PieceHash> piece_hashes;
 
 public:
     MetaInfo(std::filesystem::path torrent_file);
@@ -36,19 +57,34 @@ public:
     std::string get_announceURL();
 
     /**
-     * @brief returns the file size
+     * @brief returns the file size, the total size of the files for a multi-file torrent
      *
      * @return size_t
      */
     size_t get_file_size();
 
     /**
-     * @brief returns the suggested name for the file
+     * @brief returns the suggested name for the file, or for the directory of the files of a multi-file torrent
      *
      * @return std::string
      */
     std::string get_name();
 
+    /**
+     * @brief returns the files of the torrent in the order they are laid out, a single file for a single-file torrent
+     *
+     * @return const std::vector<TorrentFile>&
+     */
+    const std::vector<TorrentFile> &get_files();
+
+    /**
+     * @brief returns true if the torrent lists its files (info.files) rather than being a single file (info.length)
+     *
+     * @return true
+     * @return false
+     */
+    bool is_multi_file();
+
     /**
      * @brief returns the piece length
      *
@@ -56,6 +92,14 @@ public:
      */
     size_t get_piece_length();
 
+    /**
+     * @brief returns the length of the piece with the given index, the last piece may be shorter than the others
+     *
+     * @param piece_index
+     * @return size_t
+     */
+    size_t get_piece_length(size_t piece_index);
+
     /**
      * @brief converts a string to its hexadecimal representation
      *
@@ -64,6 +108,21 @@ public:
      */
     std::string stringToHex(const std::string &input);
 
+    /**
+     * @brief returns the number of pieces
+     *
+     * @return size_t
+     */
+    size_t get_number_of_pieces();
+
+    /**
+     * @brief returns the binary hash of the piece with the given index
+     *
+     * @param piece_index
+     * @return const PieceHash&
+     */
+    const PieceHash &get_piece_hash(size_t piece_index);
+
     /**
      * @brief returns the pieces hash string in the hexadecimal format
      *
@@ -86,16 +145,17 @@ public:
     json to_json();
 
     /**
-     * @brief returns the info hash of the torrent file
+     * @brief returns the info hash of the torrent file in the hexadecimal format
      *
      * @return std::string
      */
     std::string get_info_hash();
 
     /**
-     * @brief returns the info string of the torrent file in the hexadecimal format
+     * @brief returns the 20 byte info hash of the torrent file as sent to the tracker and peers,
+     * a view of the hash kept in MetaInfo so every handshake doesn't allocate a copy
      *
-     * @return std::string
+     * @return std::string_view
      */
-    std::string get_info_string();
+    std::string_view get_info_string();
 };
\ No newline at end of file
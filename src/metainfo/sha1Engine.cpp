@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "metainfo/sha1Engine.hpp"
+
+namespace
+{
+    // compresses whole 64 byte blocks into the state
+    using CompressFunction = void (*)(uint32_t state[5], const uint8_t *data, size_t blocks);
+
+    inline uint32_t rol(uint32_t value, int bits)
+    {
+        return (value << bits) | (value >> (32 - bits));
+    }
+
+    inline uint32_t load_big_endian(const uint8_t *data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        if constexpr (std::endian::native == std::endian::little)
+        {
+            value = std::byteswap(value);
+        }
+        return value;
+    }
+
+    void compress_scalar(uint32_t state[5], const uint8_t *data, size_t blocks)
+    {
+        while (blocks--)
+        {
+            // the message schedule only ever needs the last 16 words
+            uint32_t w[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                w[i] = load_big_endian(data + 4 * i);
+            }
+
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+            auto round = [&](int i, uint32_t f, uint32_t k)
+            {
+                if (i >= 16)
+                {
+                    w[i & 15] = rol(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+                }
+
+                uint32_t t = rol(a, 5) + f + e + k + w[i & 15];
+                e = d;
+                d = c;
+                c = rol(b, 30);
+                b = a;
+                a = t;
+            };
+
+#pragma GCC unroll 20
+            for (int i = 0; i < 20; ++i)
+            {
+                round(i, d ^ (b & (c ^ d)), 0x5a827999);
+            }
+#pragma GCC unroll 20
+            for (int i = 20; i < 40; ++i)
+            {
+                round(i, b ^ c ^ d, 0x6ed9eba1);
+            }
+#pragma GCC unroll 20
+            for (int i = 40; i < 60; ++i)
+            {
+                round(i, (b & c) | (d & (b | c)), 0x8f1bbcdc);
+            }
+#pragma GCC unroll 20
+            for (int i = 60; i < 80; ++i)
+            {
+                round(i, b ^ c ^ d, 0xca62c1d6);
+            }
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+
+            data += 64;
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    bool has_sha_ni()
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        {
+            return false;
+        }
+        bool has_ssse3 = ecx & (1u << 9);
+        bool has_sse41 = ecx & (1u << 19);
+
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        {
+            return false;
+        }
+        bool has_sha = ebx & (1u << 29);
+
+        return has_ssse3 && has_sse41 && has_sha;
+    }
+
+    // four rounds of group g (0-19), msg[] holds the message words of groups g to g + 3 as they are expanded
+#define SHA1_NI_GROUP(g, e_in, e_out)                                                                \
+    e_in = _mm_sha1nexte_epu32(e_in, msg[(g) % 4]);                                                  \
+    e_out = abcd;                                                                                    \
+    if constexpr ((g) >= 3 && (g) <= 18)                                                             \
+    {                                                                                                \
+        msg[((g) + 1) % 4] = _mm_sha1msg2_epu32(msg[((g) + 1) % 4], msg[(g) % 4]);                   \
+    }                                                                                                \
+    abcd = _mm_sha1rnds4_epu32(abcd, e_in, (g) / 5);                                                 \
+    if constexpr ((g) >= 1 && (g) <= 16)                                                             \
+    {                                                                                                \
+        msg[((g) + 3) % 4] = _mm_sha1msg1_epu32(msg[((g) + 3) % 4], msg[(g) % 4]);                   \
+    }                                                                                                \
+    if constexpr ((g) >= 2 && (g) <= 17)                                                             \
+    {                                                                                                \
+        msg[((g) + 2) % 4] = _mm_xor_si128(msg[((g) + 2) % 4], msg[(g) % 4]);                        \
+    }
+
+    __attribute__((target("sha,ssse3,sse4.1"))) void compress_sha_ni(uint32_t state[5], const uint8_t *data, size_t blocks)
+    {
+        const __m128i BYTE_SWAP = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+        __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0x1b);
+        __m128i e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+        while (blocks--)
+        {
+            __m128i abcd_saved = abcd;
+            __m128i e0_saved = e0;
+            __m128i e1;
+            __m128i msg[4];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                msg[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), BYTE_SWAP);
+            }
+
+            // the first group adds E directly, the others derive it from the previous ABCD
+            e0 = _mm_add_epi32(e0, msg[0]);
+            e1 = abcd;
+            abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+            SHA1_NI_GROUP(1, e1, e0)
+            SHA1_NI_GROUP(2, e0, e1)
+            SHA1_NI_GROUP(3, e1, e0)
+            SHA1_NI_GROUP(4, e0, e1)
+            SHA1_NI_GROUP(5, e1, e0)
+            SHA1_NI_GROUP(6, e0, e1)
+            SHA1_NI_GROUP(7, e1, e0)
+            SHA1_NI_GROUP(8, e0, e1)
+            SHA1_NI_GROUP(9, e1, e0)
+            SHA1_NI_GROUP(10, e0, e1)
+            SHA1_NI_GROUP(11, e1, e0)
+            SHA1_NI_GROUP(12, e0, e1)
+            SHA1_NI_GROUP(13, e1, e0)
+            SHA1_NI_GROUP(14, e0, e1)
+            SHA1_NI_GROUP(15, e1, e0)
+            SHA1_NI_GROUP(16, e0, e1)
+            SHA1_NI_GROUP(17, e1, e0)
+            SHA1_NI_GROUP(18, e0, e1)
+            SHA1_NI_GROUP(19, e1, e0)
+
+            e0 = _mm_sha1nexte_epu32(e0, e0_saved);
+            abcd = _mm_add_epi32(abcd, abcd_saved);
+
+            data += 64;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_shuffle_epi32(abcd, 0x1b));
+        state[4] = _mm_extract_epi32(e0, 3);
+    }
+
+#undef SHA1_NI_GROUP
+#endif
+
+#if defined(__aarch64__) && defined(__linux__)
+    bool has_armv8_sha1()
+    {
+        return getauxval(AT_HWCAP) & HWCAP_SHA1;
+    }
+
+    // four rounds of group g (0-19): e[] alternates between the E of this group and the next,
+    // tmp[] holds the message words plus constant of groups g and g + 1, msg[] the words of groups g to g + 3
+#define SHA1_ARM_GROUP(g, op)                                                                        \
+    e[((g) + 1) % 2] = vsha1h_u32(vgetq_lane_u32(abcd, 0));                                          \
+    abcd = op(abcd, e[(g) % 2], tmp[(g) % 2]);                                                       \
+    if constexpr ((g) <= 17)                                                                         \
+    {                                                                                                \
+        tmp[(g) % 2] = vaddq_u32(msg[((g) + 2) % 4], vdupq_n_u32(K[((g) + 2) / 5]));                 \
+    }                                                                                                \
+    if constexpr ((g) >= 1 && (g) <= 16)                                                             \
+    {                                                                                                \
+        msg[((g) + 3) % 4] = vsha1su1q_u32(msg[((g) + 3) % 4], msg[((g) + 2) % 4]);                  \
+    }                                                                                                \
+    if constexpr ((g) <= 15)                                                                         \
+    {                                                                                                \
+        msg[(g) % 4] = vsha1su0q_u32(msg[(g) % 4], msg[((g) + 1) % 4], msg[((g) + 2) % 4]);          \
+    }
+
+    __attribute__((target("+crypto"))) void compress_armv8(uint32_t state[5], const uint8_t *data, size_t blocks)
+    {
+        static constexpr uint32_t K[4] = {0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6};
+
+        uint32x4_t abcd = vld1q_u32(state);
+        uint32_t e[2] = {state[4], 0};
+
+        while (blocks--)
+        {
+            uint32x4_t abcd_saved = abcd;
+            uint32_t e0_saved = e[0];
+            uint32x4_t msg[4];
+            uint32x4_t tmp[2];
+
+            for (int i = 0; i < 4; ++i)
+            {
+                msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+            }
+            tmp[0] = vaddq_u32(msg[0], vdupq_n_u32(K[0]));
+            tmp[1] = vaddq_u32(msg[1], vdupq_n_u32(K[0]));
+
+            SHA1_ARM_GROUP(0, vsha1cq_u32)
+            SHA1_ARM_GROUP(1, vsha1cq_u32)
+            SHA1_ARM_GROUP(2, vsha1cq_u32)
+            SHA1_ARM_GROUP(3, vsha1cq_u32)
+            SHA1_ARM_GROUP(4, vsha1cq_u32)
+            SHA1_ARM_GROUP(5, vsha1pq_u32)
+            SHA1_ARM_GROUP(6, vsha1pq_u32)
+            SHA1_ARM_GROUP(7, vsha1pq_u32)
+            SHA1_ARM_GROUP(8, vsha1pq_u32)
+            SHA1_ARM_GROUP(9, vsha1pq_u32)
+            SHA1_ARM_GROUP(10, vsha1mq_u32)
+            SHA1_ARM_GROUP(11, vsha1mq_u32)
+            SHA1_ARM_GROUP(12, vsha1mq_u32)
+            SHA1_ARM_GROUP(13, vsha1mq_u32)
+            SHA1_ARM_GROUP(14, vsha1mq_u32)
+            SHA1_ARM_GROUP(15, vsha1pq_u32)
+            SHA1_ARM_GROUP(16, vsha1pq_u32)
+            SHA1_ARM_GROUP(17, vsha1pq_u32)
+            SHA1_ARM_GROUP(18, vsha1pq_u32)
+            SHA1_ARM_GROUP(19, vsha1pq_u32)
+
+            e[0] += e0_saved;
+            abcd = vaddq_u32(abcd_saved, abcd);
+
+            data += 64;
+        }
+
+        vst1q_u32(state, abcd);
+        state[4] = e[0];
+    }
+
+#undef SHA1_ARM_GROUP
+#endif
+
+    struct Implementation
+    {
+        CompressFunction compress;
+        const char *name;
+    };
+
+    // every implementation this CPU can run, fastest first
+    const std::vector<Implementation> &available_implementations()
+    {
+        static const std::vector<Implementation> implementations = []()
+        {
+            std::vector<Implementation> found;
+#if defined(__x86_64__) || defined(__i386__)
+            if (has_sha_ni())
+            {
+                found.push_back({compress_sha_ni, "sha-ni"});
+            }
+#endif
+#if defined(__aarch64__) && defined(__linux__)
+            if (has_armv8_sha1())
+            {
+                found.push_back({compress_armv8, "armv8"});
+            }
+#endif
+            found.push_back({compress_scalar, "scalar"});
+            return found;
+        }();
+
+        return implementations;
+    }
+
+    const Implementation &select_implementation()
+    {
+        return available_implementations().front();
+    }
+}
+
+Sha1Engine::Sha1Engine()
+{
+    this->compress = select_implementation().compress;
+    this->reset();
+}
+
+void Sha1Engine::reset()
+{
+    this->state[0] = 0x67452301;
+    this->state[1] = 0xefcdab89;
+    this->state[2] = 0x98badcfe;
+    this->state[3] = 0x10325476;
+    this->state[4] = 0xc3d2e1f0;
+    this->buffered = 0;
+    this->total_size = 0;
+}
+
+void Sha1Engine::update(const uint8_t *data, size_t size)
+{
+    this->total_size += size;
+
+    if (this->buffered > 0)
+    {
+        size_t taken = std::min(size, sizeof(this->buffer) - this->buffered);
+        std::memcpy(this->buffer + this->buffered, data, taken);
+        this->buffered += taken;
+        data += taken;
+        size -= taken;
+
+        if (this->buffered < sizeof(this->buffer))
+        {
+            return;
+        }
+        this->compress(this->state, this->buffer, 1);
+        this->buffered = 0;
+    }
+
+    // whole blocks are hashed straight from the input
+    size_t blocks = size / 64;
+    if (blocks > 0)
+    {
+        this->compress(this->state, data, blocks);
+        data += blocks * 64;
+        size -= blocks * 64;
+    }
+
+    std::memcpy(this->buffer, data, size);
+    this->buffered = size;
+}
+
+void Sha1Engine::update(std::string_view data)
+{
+    this->update(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+}
+
+Sha1Digest Sha1Engine::final()
+{
+    uint64_t total_bits = this->total_size * 8;
+
+    // pad with 0x80, zeros up to 56 bytes mod 64, then the big-endian bit length
+    uint8_t padding[72] = {0x80};
+    size_t padding_size = (this->buffered < 56 ? 56 : 120) - this->buffered;
+    for (int i = 0; i < 8; ++i)
+    {
+        padding[padding_size + i] = static_cast<uint8_t>(total_bits >> (56 - 8 * i));
+    }
+    this->update(padding, padding_size + 8);
+
+    Sha1Digest digest;
+    for (int i = 0; i < 5; ++i)
+    {
+        digest[4 * i] = static_cast<uint8_t>(this->state[i] >> 24);
+        digest[4 * i + 1] = static_cast<uint8_t>(this->state[i] >> 16);
+        digest[4 * i + 2] = static_cast<uint8_t>(this->state[i] >> 8);
+        digest[4 * i + 3] = static_cast<uint8_t>(this->state[i]);
+    }
+
+    this->reset();
+    return digest;
+}
+
+Sha1Digest Sha1Engine::hash(const uint8_t *data, size_t size)
+{
+    Sha1Engine engine;
+    engine.update(data, size);
+    return engine.final();
+}
+
+std::string Sha1Engine::get_implementation()
+{
+    return select_implementation().name;
+}
+
+std::vector<std::string> Sha1Engine::get_available_implementations()
+{
+    std::vector<std::string> names;
+    for (const Implementation &implementation : available_implementations())
+    {
+        names.push_back(implementation.name);
+    }
+    return names;
+}
+
+Sha1Digest Sha1Engine::hash_with(const std::string &implementation, const uint8_t *data, size_t size)
+{
+    for (const Implementation &candidate : available_implementations())
+    {
+        if (candidate.name == implementation)
+        {
+            Sha1Engine engine;
+            engine.compress = candidate.compress;
+            engine.update(data, size);
+            return engine.final();
+        }
+    }
+
+    throw std::runtime_error("SHA-1 implementation not available: " + implementation);
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using Sha1Digest = std::array<uint8_t, 20>;
+
+// SHA-1 over byte spans returning the binary digest. The compression function is picked once at runtime:
+// SHA-NI on x86, the ARMv8 crypto extension on aarch64, or an unrolled scalar implementation.
+class Sha1Engine
+{
+private:
+    void (*compress)(uint32_t state[5], const uint8_t *data, size_t blocks);
+    uint32_t state[5];
+    uint8_t buffer[64];
+    size_t buffered;
+    uint64_t total_size;
+
+public:
+    Sha1Engine();
+
+    /**
+     * @brief starts a new hash
+     *
+     */
+    void reset();
+
+    /**
+     * @brief hashes the next bytes of the message
+     *
+     * @param data
+     * @param size
+     */
+    void update(const uint8_t *data, size_t size);
+
+    /**
+     * @brief hashes the next bytes of the message
+     *
+     * @param data
+     */
+    void update(std::string_view data);
+
+    /**
+     * @brief pads the message and returns its digest, the engine is reset afterwards
+     *
+     * @return Sha1Digest
+     */
+    Sha1Digest final();
+
+    /**
+     * @brief returns the digest of a whole message
+     *
+     * @param data
+     * @param size
+     * @return Sha1Digest
+     */
+    static Sha1Digest hash(const uint8_t *data, size_t size);
+
+    /**
+     * @brief returns the name of the compression function in use: "sha-ni", "armv8" or "scalar"
+     *
+     * @return std::string
+     */
+    static std::string get_implementation();
+
+    /**
+     * @brief returns the names of the compression functions this CPU can run, the one in use first
+     *
+     * @return std::vector<std::string>
+     */
+    static std::vector<std::string> get_available_implementations();
+
+    /**
+     * @brief returns the digest of a whole message computed with the named compression function, to compare them
+     *
+     * @param implementation one of get_available_implementations()
+     * @param data
+     * @param size
+     * @return Sha1Digest
+     */
+    static Sha1Digest hash_with(const std::string &implementation, const uint8_t *data, size_t size);
+};
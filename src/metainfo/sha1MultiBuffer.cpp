@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "metainfo/sha1MultiBuffer.hpp"
+#include "metainfo/sha1Engine.hpp"
+
+namespace
+{
+    constexpr size_t MAX_LANES = 16;
+
+    // compresses whole blocks of every lane, state holds word i of lane j at state[i * lanes + j]
+    using CompressLanesFunction = void (*)(uint32_t *state, const uint8_t *const *data, size_t blocks);
+
+    // shuffle indices of a block swap in transpose_lanes(), rows r and r + BLOCK trade the words whose column has the
+    // BLOCK bit set in r against those that have it cleared in r + BLOCK; indices >= LANES pick from the second row
+    template <size_t LANES, size_t BLOCK>
+    constexpr int lower_swap_index(size_t i)
+    {
+        return (i & BLOCK) == 0 ? i : i - BLOCK + LANES;
+    }
+
+    template <size_t LANES, size_t BLOCK>
+    constexpr int upper_swap_index(size_t i)
+    {
+        return (i & BLOCK) == 0 ? i + BLOCK : i + LANES;
+    }
+
+    template <typename Vector, size_t LANES, size_t BLOCK, size_t... I>
+    [[gnu::always_inline]] inline void swap_blocks(Vector *rows, std::index_sequence<I...>)
+    {
+        for (size_t row = 0; row < LANES; ++row)
+        {
+            if ((row & BLOCK) == 0)
+            {
+                Vector lower = __builtin_shufflevector(rows[row], rows[row + BLOCK], lower_swap_index<LANES, BLOCK>(I)...);
+                Vector upper = __builtin_shufflevector(rows[row], rows[row + BLOCK], upper_swap_index<LANES, BLOCK>(I)...);
+                rows[row] = lower;
+                rows[row + BLOCK] = upper;
+            }
+        }
+    }
+
+    // transposes a LANES x LANES matrix of words held one row per vector, log2(LANES) rounds of in-register shuffles
+    template <typename Vector, size_t LANES, size_t BLOCK = 1>
+    [[gnu::always_inline]] inline void transpose_lanes(Vector *rows)
+    {
+        if constexpr (BLOCK < LANES)
+        {
+            swap_blocks<Vector, LANES, BLOCK>(rows, std::make_index_sequence<LANES>());
+            transpose_lanes<Vector, LANES, BLOCK * 2>(rows);
+        }
+    }
+
+// rotates every lane left and swaps the bytes of every lane (the kernels only run on little-endian x86 and aarch64),
+// macros since vector-returning helpers outside the target functions trip -Wpsabi
+#define SHA1_LANES_ROL(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+#define SHA1_LANES_BYTESWAP(value) (((value) << 24) | (((value) & 0xff00) << 8) | (((value) >> 8) & 0xff00) | ((value) >> 24))
+
+    // the scalar rounds with every word widened to a vector of lanes, inlined into each target-specific wrapper
+    template <typename Vector, size_t LANES>
+    [[gnu::always_inline]] inline void compress_lanes(uint32_t *state, const uint8_t *const *data, size_t blocks)
+    {
+        Vector h[5];
+        std::memcpy(h, state, sizeof(h));
+
+        for (size_t block = 0; block < blocks; ++block)
+        {
+            // each lane's words are loaded whole vectors at a time and transposed, so w[t] holds word t of every lane
+            Vector w[16];
+            for (size_t first_word = 0; first_word < 16; first_word += LANES)
+            {
+                Vector *rows = w + first_word;
+                for (size_t lane = 0; lane < LANES; ++lane)
+                {
+                    std::memcpy(&rows[lane], data[lane] + block * 64 + 4 * first_word, sizeof(Vector));
+                }
+                transpose_lanes<Vector, LANES>(rows);
+            }
+            for (int t = 0; t < 16; ++t)
+            {
+                w[t] = SHA1_LANES_BYTESWAP(w[t]);
+            }
+
+            Vector a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+            auto round = [&](int i, const Vector &f, uint32_t k)
+            {
+                if (i >= 16)
+                {
+                    w[i & 15] = SHA1_LANES_ROL(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+                }
+
+                Vector t = SHA1_LANES_ROL(a, 5) + f + e + k + w[i & 15];
+                e = d;
+                d = c;
+                c = SHA1_LANES_ROL(b, 30);
+                b = a;
+                a = t;
+            };
+
+#pragma GCC unroll 20
+            for (int i = 0; i < 20; ++i)
+            {
+                round(i, d ^ (b & (c ^ d)), 0x5a827999);
+            }
+#pragma GCC unroll 20
+            for (int i = 20; i < 40; ++i)
+            {
+                round(i, b ^ c ^ d, 0x6ed9eba1);
+            }
+#pragma GCC unroll 20
+            for (int i = 40; i < 60; ++i)
+            {
+                round(i, (b & c) | (d & (b | c)), 0x8f1bbcdc);
+            }
+#pragma GCC unroll 20
+            for (int i = 60; i < 80; ++i)
+            {
+                round(i, b ^ c ^ d, 0xca62c1d6);
+            }
+
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+        }
+
+        std::memcpy(state, h, sizeof(h));
+    }
+
+#undef SHA1_LANES_ROL
+#undef SHA1_LANES_BYTESWAP
+
+#if defined(__x86_64__) || defined(__i386__)
+    typedef uint32_t Lanes4 __attribute__((vector_size(16)));
+    typedef uint32_t Lanes8 __attribute__((vector_size(32)));
+    typedef uint32_t Lanes16 __attribute__((vector_size(64)));
+
+    __attribute__((target("sse2"))) void compress_sse2(uint32_t *state, const uint8_t *const *data, size_t blocks)
+    {
+        compress_lanes<Lanes4, 4>(state, data, blocks);
+    }
+
+    __attribute__((target("avx2"))) void compress_avx2(uint32_t *state, const uint8_t *const *data, size_t blocks)
+    {
+        compress_lanes<Lanes8, 8>(state, data, blocks);
+    }
+
+    __attribute__((target("avx512f"))) void compress_avx512(uint32_t *state, const uint8_t *const *data, size_t blocks)
+    {
+        compress_lanes<Lanes16, 16>(state, data, blocks);
+    }
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    typedef uint32_t Lanes4 __attribute__((vector_size(16)));
+
+    void compress_neon(uint32_t *state, const uint8_t *const *data, size_t blocks)
+    {
+        compress_lanes<Lanes4, 4>(state, data, blocks);
+    }
+#endif
+
+    struct Kernel
+    {
+        CompressLanesFunction compress;
+        size_t lanes;
+        const char *name;
+    };
+
+    // every kernel this CPU can run, widest first
+    const std::vector<Kernel> &available_kernels()
+    {
+        static const std::vector<Kernel> kernels = []()
+        {
+            std::vector<Kernel> found;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f"))
+            {
+                found.push_back({compress_avx512, 16, "avx512"});
+            }
+            if (__builtin_cpu_supports("avx2"))
+            {
+                found.push_back({compress_avx2, 8, "avx2"});
+            }
+            if (__builtin_cpu_supports("sse2"))
+            {
+                found.push_back({compress_sse2, 4, "sse2"});
+            }
+#endif
+#if defined(__aarch64__) && defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            found.push_back({compress_neon, 4, "neon"});
+#endif
+            found.push_back({nullptr, 1, "none"});
+            return found;
+        }();
+
+        return kernels;
+    }
+
+    const Kernel &select_kernel()
+    {
+        return available_kernels().front();
+    }
+
+    void hash_group(const Kernel &kernel, const uint8_t *const data[], size_t size, Sha1Digest digests[])
+    {
+        const uint32_t INITIAL_STATE[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+        uint32_t state[5 * MAX_LANES];
+        for (size_t word = 0; word < 5; ++word)
+        {
+            std::fill_n(state + word * kernel.lanes, kernel.lanes, INITIAL_STATE[word]);
+        }
+
+        size_t blocks = size / 64;
+        kernel.compress(state, data, blocks);
+
+        // every lane has the same length, so the same padding layout: the tail, 0x80, zeros, the big-endian bit length
+        size_t tail = size % 64;
+        size_t tail_blocks = tail < 56 ? 1 : 2;
+        uint64_t total_bits = static_cast<uint64_t>(size) * 8;
+
+        uint8_t tails[MAX_LANES][128] = {};
+        const uint8_t *tail_data[MAX_LANES];
+        for (size_t lane = 0; lane < kernel.lanes; ++lane)
+        {
+            std::memcpy(tails[lane], data[lane] + blocks * 64, tail);
+            tails[lane][tail] = 0x80;
+            for (int i = 0; i < 8; ++i)
+            {
+                tails[lane][tail_blocks * 64 - 8 + i] = static_cast<uint8_t>(total_bits >> (56 - 8 * i));
+            }
+            tail_data[lane] = tails[lane];
+        }
+        kernel.compress(state, tail_data, tail_blocks);
+
+        for (size_t lane = 0; lane < kernel.lanes; ++lane)
+        {
+            for (size_t word = 0; word < 5; ++word)
+            {
+                uint32_t value = state[word * kernel.lanes + lane];
+                digests[lane][4 * word] = static_cast<uint8_t>(value >> 24);
+                digests[lane][4 * word + 1] = static_cast<uint8_t>(value >> 16);
+                digests[lane][4 * word + 2] = static_cast<uint8_t>(value >> 8);
+                digests[lane][4 * word + 3] = static_cast<uint8_t>(value);
+            }
+        }
+    }
+
+    void hash_messages(const Kernel &kernel, const uint8_t *const data[], size_t count, size_t size, Sha1Digest digests[])
+    {
+        size_t i = 0;
+        if (kernel.lanes > 1)
+        {
+            for (; i + kernel.lanes <= count; i += kernel.lanes)
+            {
+                hash_group(kernel, data + i, size, digests + i);
+            }
+        }
+
+        for (; i < count; ++i)
+        {
+            digests[i] = Sha1Engine::hash(data[i], size);
+        }
+    }
+}
+
+void Sha1MultiBuffer::hash(const uint8_t *const data[], size_t count, size_t size, Sha1Digest digests[])
+{
+    hash_messages(select_kernel(), data, count, size, digests);
+}
+
+void Sha1MultiBuffer::hash_with(size_t lanes, const uint8_t *const data[], size_t count, size_t size, Sha1Digest digests[])
+{
+    for (const Kernel &kernel : available_kernels())
+    {
+        if (kernel.lanes == lanes)
+        {
+            hash_messages(kernel, data, count, size, digests);
+            return;
+        }
+    }
+
+    throw std::runtime_error("no SHA-1 kernel with " + std::to_string(lanes) + " lanes on this CPU");
+}
+
+bool Sha1MultiBuffer::is_preferred()
+{
+    // decided from the CPU features alone: a SHA-NI or ARMv8 stream hashes about as fast as 8 lanes of
+    // AVX2 and 3 to 4 times slower than 16 lanes of AVX-512, while any group of lanes beats the scalar code
+    size_t lanes = select_kernel().lanes;
+    return lanes >= 16 || (lanes > 1 && Sha1Engine::get_implementation() == "scalar");
+}
+
+size_t Sha1MultiBuffer::get_lanes()
+{
+    return select_kernel().lanes;
+}
+
+std::vector<size_t> Sha1MultiBuffer::get_available_lanes()
+{
+    std::vector<size_t> lanes;
+    for (const Kernel &kernel : available_kernels())
+    {
+        lanes.push_back(kernel.lanes);
+    }
+    return lanes;
+}
+
+std::string Sha1MultiBuffer::get_implementation()
+{
+    return select_kernel().name;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "metainfo/sha1Engine.hpp"
+
+// Hashes several independent messages of the same length at once, one message per SIMD lane
+// (4 lanes with SSE2 or NEON, 8 with AVX2, 16 with AVX-512). Messages that don't fill a whole group of lanes,
+// and CPUs without these extensions, go through Sha1Engine one at a time.
+class Sha1MultiBuffer
+{
+public:
+    /**
+     * @brief computes the digests of count messages of size bytes each
+     *
+     * @param data pointers to the messages
+     * @param count
+     * @param size
+     * @param digests receives the digest of each message
+     */
+    static void hash(const uint8_t *const data[], size_t count, size_t size, Sha1Digest digests[]);
+
+    /**
+     * @brief returns the number of messages hashed together, 1 if no multi-buffer kernel is available
+     *
+     * @return size_t
+     */
+    static size_t get_lanes();
+
+    /**
+     * @brief returns the lane counts of the kernels this CPU can run, the one in use first, 1 stands for Sha1Engine
+     *
+     * @return std::vector<size_t>
+     */
+    static std::vector<size_t> get_available_lanes();
+
+    /**
+     * @brief computes the digests of count messages of size bytes each with the kernel of the given lane count, to compare them
+     *
+     * @param lanes one of get_available_lanes()
+     * @param data pointers to the messages
+     * @param count
+     * @param size
+     * @param digests receives the digest of each message
+     */
+    static void hash_with(size_t lanes, const uint8_t *const data[], size_t count, size_t size, Sha1Digest digests[]);
+
+    /**
+     * @brief returns true if a full group of lanes hashes faster than Sha1Engine hashes the messages one by one,
+     * decided from the CPU features: always with 16 lanes, with fewer only when Sha1Engine has no hardware SHA-1
+     *
+     * @return true
+     * @return false
+     */
+    static bool is_preferred();
+
+    /**
+     * @brief returns the name of the kernel in use: "avx512", "avx2", "sse2", "neon" or "none"
+     *
+     * @return std::string
+     */
+    static std::string get_implementation();
+};
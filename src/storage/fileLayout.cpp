@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "storage/fileLayout.hpp"
+#include "metainfo/metainfo.hpp"
+
+FileLayout::FileLayout(const std::vector<TorrentFile> &files)
+{
+    uint64_t offset = 0;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (files[i].length == 0)
+        {
+            continue;
+        }
+
+        this->starts.push_back(offset);
+        this->file_indices.push_back(i);
+        offset += files[i].length;
+    }
+
+    // the end of the last file, so the length of every indexed file is the distance to the next start
+    this->starts.push_back(offset);
+}
+
+std::vector<FileSpan> FileLayout::get_spans(uint64_t offset, size_t length) const
+{
+    if (offset + length > this->get_total_size())
+    {
+        throw std::runtime_error("Range at " + std::to_string(offset) + " of " + std::to_string(length) + " bytes is past the end of the files");
+    }
+
+    std::vector<FileSpan> spans;
+    if (length == 0)
+    {
+        return spans;
+    }
+
+    // the last file starting at or before the offset
+    size_t entry = std::upper_bound(this->starts.begin(), this->starts.end(), offset) - this->starts.begin() - 1;
+
+    size_t range_offset = 0;
+    while (range_offset < length)
+    {
+        uint64_t position = offset + range_offset;
+        size_t span_length = std::min<uint64_t>(length - range_offset, this->starts[entry + 1] - position);
+
+        spans.push_back(FileSpan{this->file_indices[entry], position - this->starts[entry], span_length, range_offset});
+        range_offset += span_length;
+        entry++;
+    }
+
+    return spans;
+}
+
+uint64_t FileLayout::get_total_size() const
+{
+    return this->starts.back();
+}
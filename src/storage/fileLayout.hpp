@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "metainfo/metainfo.hpp"
+
+// a run of bytes of the torrent that lies within one file
+struct FileSpan
+{
+    size_t file_index;
+    uint64_t file_offset;
+    size_t length;
+    // where the span starts in the range it was cut from, e.g. in the piece
+    size_t range_offset;
+};
+
+// Maps byte ranges of the torrent (the files laid out back to back) to the files they lie in.
+// The offsets the files start at are computed once and kept sorted, so the file a range starts in
+// is found by binary search: a piece costs O(log files) to place, even in torrents with 100k+ files.
+// Empty files take no bytes and aren't part of the index.
+class FileLayout
+{
+private:
+    // offsets the non-empty files start at in the torrent, ascending, one past the last byte at the end
+    std::vector<uint64_t> starts;
+    // the file each entry of starts belongs to
+    std::vector<size_t> file_indices;
+
+public:
+    /**
+     * @brief builds the index of the files of the torrent
+     *
+     * @param files
+     */
+    FileLayout(const std::vector<TorrentFile> &files);
+
+    /**
+     * @brief splits a range of the torrent at the file boundaries
+     *
+     * @param offset offset of the range in the torrent
+     * @param length
+     * @return std::vector<FileSpan> the spans in the order of the range, throws if the range is past the end of the torrent
+     */
+    std::vector<FileSpan> get_spans(uint64_t offset, size_t length) const;
+
+    /**
+     * @brief returns the total size of the files
+     *
+     * @return uint64_t
+     */
+    uint64_t get_total_size() const;
+};
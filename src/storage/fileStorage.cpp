@@ -0,0 +1,70 @@
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "storage/fileStorage.hpp"
+#include "storage/fileLayout.hpp"
+#include "metainfo/metainfo.hpp"
+
+FileStorage::FileStorage(MetaInfo &metaInfo, const std::string &output_file) : Storage(metaInfo, output_file)
+{
+}
+
+void FileStorage::write_piece(size_t piece_index, const uint8_t *piece_data, size_t size)
+{
+    uint64_t offset = this->get_piece_offset(piece_index, size);
+
+    for (const FileSpan &span : this->layout.get_spans(offset, size))
+    {
+        size_t written = 0;
+        while (written < span.length)
+        {
+            ssize_t result = pwrite(this->fds[span.file_index], piece_data + span.range_offset + written, span.length - written, span.file_offset + written);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("Failed to write piece " + std::to_string(piece_index) + ": " + std::strerror(errno));
+            }
+            written += result;
+        }
+    }
+}
+
+void FileStorage::read_piece(size_t piece_index, const std::function<void(const uint8_t *piece_data, size_t size)> &visit)
+{
+    size_t size = this->get_piece_size(piece_index);
+    uint64_t offset = this->get_piece_offset(piece_index, size);
+    std::vector<uint8_t> piece_data(size);
+
+    for (const FileSpan &span : this->layout.get_spans(offset, size))
+    {
+        size_t read = 0;
+        while (read < span.length)
+        {
+            ssize_t result = pread(this->fds[span.file_index], piece_data.data() + span.range_offset + read, span.length - read, span.file_offset + read);
+            if (result < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                throw std::runtime_error("Failed to read piece " + std::to_string(piece_index) + ": " + std::strerror(errno));
+            }
+            if (result == 0)
+            {
+                throw std::runtime_error("Failed to read piece " + std::to_string(piece_index) + ": unexpected end of file");
+            }
+            read += result;
+        }
+    }
+
+    visit(piece_data.data(), size);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "metainfo/metainfo.hpp"
+#include "storage/storage.hpp"
+
+// Storage writing and reading pieces with pwrite/pread, one system call per piece (per file it spans) that copies it through the page cache.
+class FileStorage : public Storage
+{
+public:
+    /**
+     * @brief opens (or creates) the output files and preallocates them to their size in the torrent
+     *
+     * @param metaInfo
+     * @param output_file the output file, or the output directory for a multi-file torrent
+     */
+    FileStorage(MetaInfo &metaInfo, const std::string &output_file);
+
+    void write_piece(size_t piece_index, const uint8_t *piece_data, size_t size) override;
+
+    void read_piece(size_t piece_index, const std::function<void(const uint8_t *piece_data, size_t size)> &visit) override;
+};
@@ -0,0 +1,222 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "storage/mmapStorage.hpp"
+#include "storage/fileLayout.hpp"
+#include "metainfo/metainfo.hpp"
+
+MmapStorage::MmapStorage(MetaInfo &metaInfo, const std::string &output_file) : Storage(metaInfo, output_file)
+{
+    this->use_counter = 0;
+
+    for (const TorrentFile &file : metaInfo.get_files())
+    {
+        size_t number_of_windows = (file.length + WINDOW_SIZE - 1) / WINDOW_SIZE;
+        std::vector<Window> &file_windows = this->windows.emplace_back(number_of_windows);
+        for (size_t i = 0; i < number_of_windows; ++i)
+        {
+            file_windows[i].length = std::min<uint64_t>(WINDOW_SIZE, file.length - static_cast<uint64_t>(i) * WINDOW_SIZE);
+        }
+    }
+}
+
+MmapStorage::~MmapStorage()
+{
+    for (auto [file_index, window_index] : this->mapped)
+    {
+        Window &window = this->windows[file_index][window_index];
+        munmap(window.address, window.length);
+    }
+}
+
+std::vector<MmapStorage::Chunk> MmapStorage::get_chunks(uint64_t offset, size_t size)
+{
+    std::vector<Chunk> chunks;
+    for (const FileSpan &span : this->layout.get_spans(offset, size))
+    {
+        size_t done = 0;
+        while (done < span.length)
+        {
+            uint64_t file_offset = span.file_offset + done;
+            size_t window_offset = file_offset % WINDOW_SIZE;
+            size_t length = std::min<uint64_t>(span.length - done, WINDOW_SIZE - window_offset);
+
+            chunks.push_back(Chunk{span.file_index, file_offset / WINDOW_SIZE, window_offset, length, span.range_offset + done});
+            done += length;
+        }
+    }
+
+    return chunks;
+}
+
+uint8_t *MmapStorage::acquire_window(size_t file_index, size_t window_index)
+{
+    Window &window = this->windows[file_index][window_index];
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (window.address == nullptr)
+    {
+        if (this->mapped.size() >= MAX_MAPPED_WINDOWS)
+        {
+            this->evict_window();
+        }
+
+        void *address = mmap(nullptr, window.length, PROT_READ | PROT_WRITE, MAP_SHARED, this->fds[file_index], static_cast<uint64_t>(window_index) * WINDOW_SIZE);
+        if (address == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map " + this->path + ": " + std::strerror(errno));
+        }
+
+        window.address = static_cast<uint8_t *>(address);
+        this->mapped.emplace_back(file_index, window_index);
+    }
+
+    window.users++;
+    window.last_used = ++this->use_counter;
+    return window.address;
+}
+
+void MmapStorage::release_window(size_t file_index, size_t window_index)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->windows[file_index][window_index].users--;
+}
+
+void MmapStorage::evict_window()
+{
+    auto victim = this->mapped.end();
+    for (auto it = this->mapped.begin(); it != this->mapped.end(); ++it)
+    {
+        Window &window = this->windows[it->first][it->second];
+        if (window.users == 0 && (victim == this->mapped.end() || window.last_used < this->windows[victim->first][victim->second].last_used))
+        {
+            victim = it;
+        }
+    }
+
+    // every mapped window is in use, map one more for now
+    if (victim == this->mapped.end())
+    {
+        return;
+    }
+
+    // start writing the dirty pages out, unmapping leaves them in the page cache
+    Window &window = this->windows[victim->first][victim->second];
+    msync(window.address, window.length, MS_ASYNC);
+    munmap(window.address, window.length);
+    window.address = nullptr;
+    this->mapped.erase(victim);
+}
+
+void MmapStorage::write_piece(size_t piece_index, const uint8_t *piece_data, size_t size)
+{
+    uint64_t offset = this->get_piece_offset(piece_index, size);
+
+    for (const Chunk &chunk : this->get_chunks(offset, size))
+    {
+        Window &window = this->windows[chunk.file_index][chunk.window_index];
+        uint8_t *address = this->acquire_window(chunk.file_index, chunk.window_index);
+
+        // copied outside of the lock, other threads write the other pieces of the window meanwhile
+        std::memcpy(address + chunk.window_offset, piece_data + chunk.piece_offset, chunk.length);
+
+        bool window_complete;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            window.bytes_written += chunk.length;
+            window_complete = window.bytes_written == window.length;
+        }
+
+        if (window_complete)
+        {
+            // nothing is written to the window anymore, start its writeback and drop its pages from the resident set,
+            // reading a piece back faults them in again from the page cache
+            msync(address, window.length, MS_ASYNC);
+            madvise(address, window.length, MADV_DONTNEED);
+        }
+
+        this->release_window(chunk.file_index, chunk.window_index);
+    }
+}
+
+void MmapStorage::read_piece(size_t piece_index, const std::function<void(const uint8_t *piece_data, size_t size)> &visit)
+{
+    size_t size = this->get_piece_size(piece_index);
+    std::vector<Chunk> chunks = this->get_chunks(this->get_piece_offset(piece_index, size), size);
+
+    if (chunks.size() == 1)
+    {
+        const Chunk &chunk = chunks.front();
+        const uint8_t *address = this->acquire_window(chunk.file_index, chunk.window_index);
+
+        try
+        {
+            visit(address + chunk.window_offset, size);
+        }
+        catch (...)
+        {
+            this->release_window(chunk.file_index, chunk.window_index);
+            throw;
+        }
+
+        this->release_window(chunk.file_index, chunk.window_index);
+        return;
+    }
+
+    std::vector<uint8_t> piece_data(size);
+    for (const Chunk &chunk : chunks)
+    {
+        const uint8_t *address = this->acquire_window(chunk.file_index, chunk.window_index);
+        std::memcpy(piece_data.data() + chunk.piece_offset, address + chunk.window_offset, chunk.length);
+        this->release_window(chunk.file_index, chunk.window_index);
+    }
+
+    visit(piece_data.data(), size);
+}
+
+void MmapStorage::mark_piece_written(size_t piece_index)
+{
+    size_t size = this->get_piece_size(piece_index);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (const Chunk &chunk : this->get_chunks(this->get_piece_offset(piece_index, size), size))
+    {
+        Window &window = this->windows[chunk.file_index][chunk.window_index];
+        window.bytes_written += chunk.length;
+
+        // an unmapped window has no pages in the resident set, a mapped one (e.g. read back to verify it) drops them
+        if (window.bytes_written == window.length && window.address != nullptr)
+        {
+            msync(window.address, window.length, MS_ASYNC);
+            madvise(window.address, window.length, MADV_DONTNEED);
+        }
+    }
+}
+
+void MmapStorage::sync()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto [file_index, window_index] : this->mapped)
+        {
+            Window &window = this->windows[file_index][window_index];
+            if (msync(window.address, window.length, MS_SYNC) < 0)
+            {
+                throw std::runtime_error("Failed to sync " + this->path + ": " + std::strerror(errno));
+            }
+        }
+    }
+
+    // the windows unmapped before were only scheduled for writeback
+    Storage::sync();
+}
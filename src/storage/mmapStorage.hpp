@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "metainfo/metainfo.hpp"
+#include "storage/storage.hpp"
+
+// Storage copying pieces straight into shared mappings of the output files, and reading them back
+// from them without a copy, so a piece costs no system call once its window is mapped.
+// Each file is mapped in windows of WINDOW_SIZE bytes, mapped when a piece of theirs is first accessed,
+// so files larger than the address space (or RAM) work. At most MAX_MAPPED_WINDOWS stay mapped,
+// the least recently used idle one is unmapped to make room. Once every byte of a window is written
+// its writeback is started and its pages dropped from the mapping, which keeps the resident set flat;
+// the data stays in the page cache until the kernel writes it out.
+// The files are preallocated, so the pages written through the mappings have their blocks on the disk already.
+class MmapStorage : public Storage
+{
+private:
+    struct Window
+    {
+        uint8_t *address = nullptr;
+        size_t length = 0;
+        size_t bytes_written = 0;
+        // threads copying from or into the window, it isn't unmapped while there are any
+        size_t users = 0;
+        uint64_t last_used = 0;
+    };
+
+    // the part of a piece that lies within one window
+    struct Chunk
+    {
+        size_t file_index;
+        size_t window_index;
+        size_t window_offset;
+        size_t length;
+        // where the chunk starts in the piece
+        size_t piece_offset;
+    };
+
+    // a multiple of the page size, so every window starts on a page of its file
+    static constexpr size_t WINDOW_SIZE = 64 * 1024 * 1024;
+    static constexpr size_t MAX_MAPPED_WINDOWS = 16;
+
+    // the windows of each file, window i covers [i * WINDOW_SIZE, (i + 1) * WINDOW_SIZE) of the file
+    std::vector<std::vector<Window>> windows;
+    // (file, window) of the mapped windows
+    std::vector<std::pair<size_t, size_t>> mapped;
+    uint64_t use_counter;
+    std::mutex mutex;
+
+    /**
+     * @brief splits a piece at the boundaries of the files and windows it lies in
+     *
+     * @param offset offset of the piece in the torrent
+     * @param size
+     * @return std::vector<Chunk>
+     */
+    std::vector<Chunk> get_chunks(uint64_t offset, size_t size);
+
+    /**
+     * @brief maps a window if it isn't and returns its address, release_window() must be called once it was accessed
+     *
+     * @param file_index
+     * @param window_index
+     * @return uint8_t*
+     */
+    uint8_t *acquire_window(size_t file_index, size_t window_index);
+
+    /**
+     * @brief ends an access to a window started by acquire_window()
+     *
+     * @param file_index
+     * @param window_index
+     */
+    void release_window(size_t file_index, size_t window_index);
+
+    /**
+     * @brief unmaps the least recently used window nobody accesses, called with the mutex held
+     *
+     */
+    void evict_window();
+
+public:
+    /**
+     * @brief opens (or creates) the output files and preallocates them to their size in the torrent, the windows are mapped on demand
+     *
+     * @param metaInfo
+     * @param output_file the output file, or the output directory for a multi-file torrent
+     */
+    MmapStorage(MetaInfo &metaInfo, const std::string &output_file);
+
+    /**
+     * @brief unmaps the windows, the written pages stay in the page cache until they are written out
+     *
+     */
+    ~MmapStorage() override;
+
+    void write_piece(size_t piece_index, const uint8_t *piece_data, size_t size) override;
+
+    /**
+     * @brief passes a piece that lies within a single window straight from the mapping,
+     * a piece spanning several files or windows is gathered into a buffer first
+     *
+     * @param piece_index
+     * @param visit
+     */
+    void read_piece(size_t piece_index, const std::function<void(const uint8_t *piece_data, size_t size)> &visit) override;
+
+    /**
+     * @brief counts a piece into the bytes written of its windows, so a window completed by pieces restored
+     * from a resume file and pieces downloaded since is written back and dropped like any other
+     *
+     * @param piece_index
+     */
+    void mark_piece_written(size_t piece_index) override;
+
+    void sync() override;
+};
@@ -0,0 +1,167 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "storage/storage.hpp"
+#include "storage/fileStorage.hpp"
+#include "storage/mmapStorage.hpp"
+#include "metainfo/metainfo.hpp"
+
+namespace
+{
+    // opens (or creates) a file and preallocates it to its size in the torrent
+    int open_file(const std::string &path, size_t size)
+    {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+        }
+
+        // cut a longer existing file down to size, then reserve the blocks so piece writes don't fail half way through
+        if (ftruncate(fd, size) < 0)
+        {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Failed to resize " + path + ": " + std::strerror(error));
+        }
+
+        int result = size == 0 ? 0 : posix_fallocate(fd, 0, size);
+        if (result != 0 && result != EOPNOTSUPP && result != EINVAL)
+        {
+            ::close(fd);
+            throw std::runtime_error("Failed to preallocate " + path + ": " + std::strerror(result));
+        }
+
+        return fd;
+    }
+}
+
+Storage::Storage(MetaInfo &metaInfo, const std::string &output_file) : layout(metaInfo.get_files())
+{
+    this->path = output_file;
+    this->file_size = metaInfo.get_file_size();
+    this->piece_length = metaInfo.get_piece_length();
+
+    std::vector<std::string> paths = get_file_paths(metaInfo, output_file);
+    try
+    {
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            if (metaInfo.is_multi_file())
+            {
+                std::filesystem::create_directories(std::filesystem::path(paths[i]).parent_path());
+            }
+            this->fds.push_back(open_file(paths[i], metaInfo.get_files()[i].length));
+        }
+    }
+    catch (...)
+    {
+        for (int fd : this->fds)
+        {
+            ::close(fd);
+        }
+        throw;
+    }
+}
+
+Storage::~Storage()
+{
+    for (int fd : this->fds)
+    {
+        ::close(fd);
+    }
+}
+
+std::unique_ptr<Storage> Storage::create(StorageBackend backend, MetaInfo &metaInfo, const std::string &output_file)
+{
+    switch (backend)
+    {
+    case StorageBackend::PWRITE:
+        return std::make_unique<FileStorage>(metaInfo, output_file);
+    case StorageBackend::MMAP:
+        return std::make_unique<MmapStorage>(metaInfo, output_file);
+    default:
+        throw std::runtime_error("Unknown storage backend");
+    }
+}
+
+std::vector<std::string> Storage::get_file_paths(MetaInfo &metaInfo, const std::string &output_file)
+{
+    if (!metaInfo.is_multi_file())
+    {
+        return {output_file};
+    }
+
+    std::vector<std::string> paths;
+    for (const TorrentFile &file : metaInfo.get_files())
+    {
+        paths.push_back((std::filesystem::path(output_file) / file.path).string());
+    }
+
+    return paths;
+}
+
+StorageBackend Storage::parse_backend(const std::string &name)
+{
+    if (name == "pwrite")
+    {
+        return StorageBackend::PWRITE;
+    }
+    else if (name == "mmap")
+    {
+        return StorageBackend::MMAP;
+    }
+
+    throw std::runtime_error("Unknown storage backend: " + name + " (expected pwrite or mmap)");
+}
+
+uint64_t Storage::get_piece_offset(size_t piece_index, size_t size)
+{
+    uint64_t offset = static_cast<uint64_t>(piece_index) * this->piece_length;
+    if (offset + size > this->file_size)
+    {
+        throw std::runtime_error("Piece " + std::to_string(piece_index) + " does not fit into the files");
+    }
+
+    return offset;
+}
+
+size_t Storage::get_piece_size(size_t piece_index)
+{
+    uint64_t offset = static_cast<uint64_t>(piece_index) * this->piece_length;
+    if (offset >= this->file_size)
+    {
+        throw std::runtime_error("Piece " + std::to_string(piece_index) + " is past the end of the files");
+    }
+
+    return std::min<uint64_t>(this->piece_length, this->file_size - offset);
+}
+
+void Storage::mark_piece_written(size_t)
+{
+}
+
+void Storage::sync()
+{
+    for (int fd : this->fds)
+    {
+        if (fdatasync(fd) < 0)
+        {
+            throw std::runtime_error("Failed to sync " + this->path + ": " + std::strerror(errno));
+        }
+    }
+}
+
+std::string Storage::get_path()
+{
+    return this->path;
+}
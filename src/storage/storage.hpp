@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "metainfo/metainfo.hpp"
+#include "storage/fileLayout.hpp"
+
+enum class StorageBackend
+{
+    PWRITE,
+    MMAP
+};
+
+// Output files of a download, verified pieces are written to their place in the files
+// as soon as they arrive so only the pieces in flight are held in memory.
+// A single-file torrent is written to the output path, the files of a multi-file torrent into the directory at the output path,
+// and a piece spanning several files is split at their boundaries (see FileLayout).
+// The files are opened and preallocated here, the backends differ in how pieces get in and out of them.
+class Storage
+{
+protected:
+    std::string path;
+    // one per file of the torrent, in the order of MetaInfo::get_files()
+    std::vector<int> fds;
+    FileLayout layout;
+    size_t file_size;
+    size_t piece_length;
+
+    /**
+     * @brief returns the offset of a piece in the torrent, throws if size bytes from there don't fit into the files
+     *
+     * @param piece_index
+     * @param size
+     * @return uint64_t
+     */
+    uint64_t get_piece_offset(size_t piece_index, size_t size);
+
+    /**
+     * @brief returns the length of a piece, throws if it is past the end of the files
+     *
+     * @param piece_index
+     * @return size_t
+     */
+    size_t get_piece_size(size_t piece_index);
+
+public:
+    /**
+     * @brief opens (or creates) the output files and preallocates them to their size in the torrent
+     *
+     * @param metaInfo
+     * @param output_file the output file, or the output directory for a multi-file torrent
+     */
+    Storage(MetaInfo &metaInfo, const std::string &output_file);
+
+    Storage(const Storage &) = delete;
+    Storage &operator=(const Storage &) = delete;
+
+    /**
+     * @brief closes the output files
+     *
+     */
+    virtual ~Storage();
+
+    /**
+     * @brief opens the output files with the given backend
+     *
+     * @param backend
+     * @param metaInfo
+     * @param output_file
+     * @return std::unique_ptr<Storage>
+     */
+    static std::unique_ptr<Storage> create(StorageBackend backend, MetaInfo &metaInfo, const std::string &output_file);
+
+    /**
+     * @brief returns the paths the files of a torrent are written to, in the order of MetaInfo::get_files()
+     *
+     * @param metaInfo
+     * @param output_file the output file, or the output directory for a multi-file torrent
+     * @return std::vector<std::string>
+     */
+    static std::vector<std::string> get_file_paths(MetaInfo &metaInfo, const std::string &output_file);
+
+    /**
+     * @brief parses a backend name as given on the command line ("pwrite" or "mmap")
+     *
+     * @param name
+     * @return StorageBackend
+     */
+    static StorageBackend parse_backend(const std::string &name);
+
+    /**
+     * @brief writes a verified piece at its offset in the files, safe to call from several threads
+     *
+     * @param piece_index
+     * @param piece_data
+     * @param size
+     */
+    virtual void write_piece(size_t piece_index, const uint8_t *piece_data, size_t size) = 0;
+
+    /**
+     * @brief reads a piece back from the files and passes it to visit, e.g. to verify or upload it,
+     * the data is only valid during the call, safe to call from several threads
+     *
+     * @param piece_index
+     * @param visit
+     */
+    virtual void read_piece(size_t piece_index, const std::function<void(const uint8_t *piece_data, size_t size)> &visit) = 0;
+
+    /**
+     * @brief records a piece that is in the files already without writing it, e.g. one restored from a resume file
+     *
+     * @param piece_index
+     */
+    virtual void mark_piece_written(size_t piece_index);
+
+    /**
+     * @brief flushes the written pieces to the disk
+     *
+     */
+    virtual void sync();
+
+    /**
+     * @brief returns the path of the output file, or of the output directory for a multi-file torrent
+     *
+     * @return std::string
+     */
+    std::string get_path();
+};
@@ -0,0 +1,315 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <catch2/catch.hpp>
+
+#include "metainfo/metainfo.hpp"
+#include "client/bitfield.hpp"
+#include "client/blockScheduler.hpp"
+#include "client/ioEngine.hpp"
+#include "client/peerSession.hpp"
+#include "client/pieceBufferPool.hpp"
+#include "client/piecePicker.hpp"
+#include "client/requestWindow.hpp"
+
+namespace
+{
+    struct Request
+    {
+        uint32_t index;
+        uint32_t begin;
+        uint32_t length;
+    };
+
+    std::string encode_uint32(uint32_t value)
+    {
+        uint32_t network = htonl(value);
+        return std::string(reinterpret_cast<const char *>(&network), sizeof(network));
+    }
+
+    std::string encode_message(uint8_t id, const std::string &payload)
+    {
+        return encode_uint32(payload.size() + 1) + static_cast<char>(id) + payload;
+    }
+
+    // writes a single-file torrent with made-up piece hashes, the tests never complete a piece
+    std::string write_torrent(const std::string &name, size_t length, size_t piece_length)
+    {
+        size_t number_of_pieces = (length + piece_length - 1) / piece_length;
+        std::string pieces(20 * number_of_pieces, '\x11');
+
+        std::string path = (std::filesystem::temp_directory_path() / (name + ".torrent")).string();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file << "d8:announce16:http://tracker/a4:infod6:lengthi" << length << "e4:name" << name.size() << ":" << name
+             << "12:piece lengthi" << piece_length << "e6:pieces" << pieces.size() << ":" << pieces << "ee";
+        return path;
+    }
+
+    // A peer on the loopback that has every piece and unchokes right away, the test scripts what it does next
+    // on the peer's own thread
+    class FakePeer
+    {
+    private:
+        int listener;
+        int socket;
+        uint16_t port;
+        std::thread thread;
+
+    public:
+        FakePeer(MetaInfo &metaInfo, std::function<void(FakePeer &)> script) : socket(-1)
+        {
+            this->listener = ::socket(AF_INET, SOCK_STREAM, 0);
+            // a session that never shows up fails the test instead of hanging it
+            timeval timeout{10, 0};
+            setsockopt(this->listener, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t address_size = sizeof(address);
+            if (bind(this->listener, reinterpret_cast<sockaddr *>(&address), address_size) < 0 || listen(this->listener, 1) < 0 ||
+                getsockname(this->listener, reinterpret_cast<sockaddr *>(&address), &address_size) < 0)
+            {
+                throw std::runtime_error("can't listen on the loopback: " + std::string(std::strerror(errno)));
+            }
+            this->port = ntohs(address.sin_port);
+
+            std::string info_hash(metaInfo.get_info_string());
+            size_t number_of_pieces = metaInfo.get_number_of_pieces();
+            this->thread = std::thread([this, info_hash, number_of_pieces, script]()
+                                       {
+                                           try
+                                           {
+                                               this->socket = accept(this->listener, nullptr, nullptr);
+                                               if (this->socket < 0)
+                                               {
+                                                   return;
+                                               }
+                                               timeval timeout{10, 0};
+                                               setsockopt(this->socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                                               this->receive(68);
+                                               this->send(std::string("\x13") + "BitTorrent protocol" + std::string(8, '\0') + info_hash + std::string(20, 'p'));
+
+                                               std::string bitfield((number_of_pieces + 7) / 8, '\0');
+                                               for (size_t i = 0; i < number_of_pieces; ++i)
+                                               {
+                                                   bitfield[i / 8] |= static_cast<char>(0x80 >> (i % 8));
+                                               }
+                                               this->send(encode_message(5, bitfield));
+                                               this->send(encode_message(1, ""));
+
+                                               script(*this);
+                                           }
+                                           catch (const std::exception &)
+                                           {
+                                               // the session hung up first, the test checks what it left behind
+                                           } });
+        }
+
+        ~FakePeer()
+        {
+            this->thread.join();
+            if (this->socket >= 0)
+            {
+                ::close(this->socket);
+            }
+            ::close(this->listener);
+        }
+
+        std::string get_port()
+        {
+            return std::to_string(this->port);
+        }
+
+        void send(const std::string &bytes)
+        {
+            if (::send(this->socket, bytes.data(), bytes.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(bytes.size()))
+            {
+                throw std::runtime_error("send failed");
+            }
+        }
+
+        std::string receive(size_t size)
+        {
+            std::string bytes(size, '\0');
+            for (size_t received = 0; received < size;)
+            {
+                ssize_t result = recv(this->socket, bytes.data() + received, size - received, 0);
+                if (result <= 0)
+                {
+                    throw std::runtime_error("connection closed");
+                }
+                received += result;
+            }
+            return bytes;
+        }
+
+        // skips the messages of the session up to its next request
+        Request next_request()
+        {
+            while (true)
+            {
+                std::string length = this->receive(4);
+                uint32_t size;
+                std::memcpy(&size, length.data(), sizeof(size));
+                size = ntohl(size);
+                if (size == 0)
+                {
+                    continue;
+                }
+
+                std::string message = this->receive(size);
+                if (message[0] == 6 && size == 13)
+                {
+                    uint32_t fields[3];
+                    std::memcpy(fields, message.data() + 1, sizeof(fields));
+                    return Request{ntohl(fields[0]), ntohl(fields[1]), ntohl(fields[2])};
+                }
+            }
+        }
+
+        // waits until the session hangs up
+        void wait_for_close()
+        {
+            char byte;
+            while (recv(this->socket, &byte, sizeof(byte), 0) > 0)
+            {
+            }
+        }
+
+        void hang_up()
+        {
+            shutdown(this->socket, SHUT_RDWR);
+        }
+    };
+
+    // a download of a torrent, with the parts a session needs
+    struct Download
+    {
+        MetaInfo metaInfo;
+        PiecePicker picker;
+        PieceBufferPool buffers;
+        BlockScheduler scheduler;
+
+        Download(const std::string &torrent)
+            : metaInfo(torrent), picker(metaInfo.get_number_of_pieces()), buffers(metaInfo.get_piece_length()),
+              scheduler(metaInfo, picker, buffers)
+        {
+        }
+
+        Bitfield all_pieces()
+        {
+            Bitfield bitfield(this->metaInfo.get_number_of_pieces());
+            for (size_t i = 0; i < bitfield.get_size(); ++i)
+            {
+                bitfield.set(i);
+            }
+            return bitfield;
+        }
+
+        // runs a session against a peer until it closes, returns why it did
+        std::string run_session(const std::string &port)
+        {
+            std::unique_ptr<IoEngine> engine = IoEngine::create(IoBackend::EPOLL);
+            std::string reason;
+
+            SessionCallbacks callbacks;
+            callbacks.on_bitfield = [this](const Bitfield &bitfield)
+            { this->picker.add_peer(bitfield); };
+            callbacks.on_have = [](size_t) {};
+            callbacks.on_piece = [](size_t, PieceBuffer, std::optional<Sha1Digest>, std::vector<std::string>) {};
+            callbacks.on_block = [](uint32_t, uint32_t, uint32_t) {};
+            callbacks.on_blocks_released = []() {};
+            callbacks.on_connected = [](PeerSession &) {};
+            callbacks.on_closed = [&](PeerSession &, const std::string &why)
+            {
+                reason = why;
+                engine->stop();
+            };
+
+            SessionTimeouts timeouts;
+            timeouts.idle = std::chrono::seconds(5);
+            auto session = std::make_shared<PeerSession>(*engine, this->metaInfo, this->scheduler, 0, "127.0.0.1", port, callbacks, timeouts);
+            session->start();
+            engine->run();
+
+            return reason;
+        }
+    };
+}
+
+TEST_CASE("a block of the wrong length releases its request when the session closes", "[peerSession]")
+{
+    // a single piece, the session requests its first blocks
+    Download download(write_torrent("wrong-length", 16 * RequestWindow::BLOCK_SIZE, 16 * RequestWindow::BLOCK_SIZE));
+
+    FakePeer peer(download.metaInfo, [](FakePeer &peer)
+                  {
+                      Request request = peer.next_request();
+                      std::string payload = encode_uint32(request.index) + encode_uint32(request.begin) + std::string(request.length - 1, 'x');
+                      peer.send(encode_message(7, payload));
+                      peer.wait_for_close(); });
+
+    std::string reason = download.run_session(peer.get_port());
+    CHECK_THAT(reason, Catch::Contains("wrong length"));
+
+    // every request was released, so the piece went back to the picker and starts over from its first block
+    CHECK_FALSE(download.scheduler.is_endgame());
+
+    RequestWindow window;
+    uint32_t index, begin, length;
+    REQUIRE(download.scheduler.next_block(0, download.all_pieces(), window, index, begin, length));
+    CHECK(index == 0);
+    CHECK(begin == 0);
+    CHECK(length == RequestWindow::BLOCK_SIZE);
+}
+
+TEST_CASE("a session closing while it receives a block in place hands its piece back", "[peerSession][blockScheduler]")
+{
+    // one block per piece, more pieces than the session requests at first, so it isn't in endgame and
+    // receives blocks in place; every piece is single-source, owned by the session that starts it
+    Download download(write_torrent("in-place-close", 8 * RequestWindow::BLOCK_SIZE, RequestWindow::BLOCK_SIZE));
+    for (size_t i = 0; i < download.metaInfo.get_number_of_pieces(); ++i)
+    {
+        download.scheduler.set_single_source(i);
+    }
+
+    Request answered{};
+    FakePeer peer(download.metaInfo, [&](FakePeer &peer)
+                  {
+                      // the header and the first bytes of a block, then the peer leaves mid-block
+                      answered = peer.next_request();
+                      peer.send(encode_uint32(9 + answered.length) + '\x07' + encode_uint32(answered.index) + encode_uint32(answered.begin) + std::string(100, 'x'));
+                      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                      peer.hang_up(); });
+
+    download.run_session(peer.get_port());
+
+    // the piece of the block is free again for any session, along with every other piece
+    RequestWindow window;
+    bool handed_out = false;
+    for (size_t i = 0; i < 2 * download.metaInfo.get_number_of_pieces(); ++i)
+    {
+        uint32_t index, begin, length;
+        if (!download.scheduler.next_block(0, download.all_pieces(), window, index, begin, length))
+        {
+            break;
+        }
+        window.add(index, begin, length);
+        handed_out = handed_out || (index == answered.index && begin == answered.begin);
+    }
+    CHECK(handed_out);
+}